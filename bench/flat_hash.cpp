@@ -0,0 +1,89 @@
+// Compares lookups in FlatHashSet/FlatHashMap with std::unordered_set/map at field set sizes seen in queries
+// and at the NameRegistry shard sizes, for keys that are in the container and for keys that are not.
+
+#include "flat_hash.h"
+#include "name.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+using namespace fastfood;
+
+namespace {
+    template<class Container, class Key>
+    void run(const char *name, size_t size, const Container& c, const std::vector<Key>& keys)
+    {
+        constexpr size_t Lookups = 10000000;
+
+        size_t found = 0;
+        const auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < Lookups; ++i)
+            found += c.count(keys[i % keys.size()]);
+
+        const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%-28s %5zu entries %6.2f ns/lookup  (found %zu)\n", name, size, elapsed / Lookups, found);
+    }
+
+    template<class Set, class Key>
+    void run_sets(const char *name, size_t size, const std::vector<Key>& present, const std::vector<Key>& absent)
+    {
+        const Set s(present.begin(), present.end());
+        const std::string hit = std::string(name) + " hit", miss = std::string(name) + " miss";
+
+        run(hit.c_str(), size, s, present);
+        run(miss.c_str(), size, s, absent);
+    }
+}
+
+int main()
+{
+    std::mt19937_64 rng(42);
+
+    for (size_t size: {4u, 16u, 64u, 256u, 1024u})
+    {
+        std::vector<Name> present, absent;
+        std::vector<std::string> strings;
+
+        for (size_t i = 0; i < size * 2; ++i)
+            strings.push_back("timer-component" + std::to_string(size * 1000 + i) + "-time");
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            present.emplace_back(strings[i]);
+            absent.emplace_back(strings[size + i]);
+        }
+
+        // Lookups in random order
+        std::shuffle(present.begin(), present.end(), rng);
+
+        run_sets<std::unordered_set<Name>>("unordered_set<Name>", size, present, absent);
+        run_sets<FlatHashSet<Name>>("FlatHashSet<Name>", size, present, absent);
+
+        std::vector<string_view> present_views(strings.begin(), strings.begin() + size);
+        std::vector<string_view> absent_views(strings.begin() + size, strings.end());
+        std::unordered_map<string_view, size_t> std_map;
+        FlatHashMap<string_view, size_t> flat_map;
+
+        for (auto& s: present_views)
+        {
+            std_map.emplace(s, s.size());
+            flat_map.emplace(s, s.size());
+        }
+
+        run("unordered_map<string> hit", size, std_map, present_views);
+        run("unordered_map<string> miss", size, std_map, absent_views);
+        run("FlatHashMap<string> hit", size, flat_map, present_views);
+        run("FlatHashMap<string> miss", size, flat_map, absent_views);
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Measures the throughput of Name lookups from many threads at once and compares it with a single
+// shared_mutex protected map like the NameRegistry used to be.
+
+#include "name.h"
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+using namespace fastfood;
+
+namespace {
+    class LockedRegistry
+    {
+    public:
+        const std::string *get(string_view s)
+        {
+            boost::shared_lock<boost::shared_mutex> read_lock(m_mux);
+
+            auto it = m_strings.find(s);
+            if (it != m_strings.end())
+                return it->second.get();
+
+            read_lock.unlock();
+            boost::unique_lock<boost::shared_mutex> write_lock(m_mux);
+
+            auto it2 = m_strings.find(s);
+            if (it2 != m_strings.end())
+                return it2->second.get();
+
+            std::unique_ptr<std::string> entry(new std::string{s.to_string()});
+            auto res = entry.get();
+            m_strings.emplace(string_view{*res}, std::move(entry));
+            return res;
+        }
+
+    private:
+        boost::shared_mutex m_mux;
+        std::unordered_map<string_view, std::unique_ptr<std::string>> m_strings;
+    };
+
+    template<class Lookup>
+    void run(const char *name, unsigned threads, const std::vector<std::string>& names, Lookup lookup)
+    {
+        constexpr size_t Rounds = 2000;
+
+        std::atomic<bool> go{false};
+        std::atomic<size_t> checksum{0};
+        std::vector<std::thread> workers;
+
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&]
+            {
+                while (!go)
+                    std::this_thread::yield();
+
+                size_t sum = 0;
+                for (size_t r = 0; r < Rounds; ++r)
+                    for (auto& s: names)
+                        sum += lookup(string_view{s});
+
+                checksum += sum;
+            });
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        go = true;
+
+        for (auto& w: workers)
+            w.join();
+
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%-16s %2u threads %9.2f M lookups/s  (checksum %zu)\n",
+            name, threads, double(threads) * Rounds * names.size() / elapsed / 1e6, size_t(checksum));
+    }
+}
+
+int main()
+{
+    // Field names as they appear in recs files
+    std::vector<std::string> names{"Name", "Id", "Time", "UserTime", "SystemTime", "Status"};
+
+    for (int i = 0; i < 50; ++i)
+    {
+        const auto n = std::to_string(i);
+        names.push_back("F" + n);
+        names.push_back("timer-component" + n + "-time");
+        names.push_back("timer-component" + n + "-count");
+        names.push_back("counter-component" + n + "-value");
+    }
+
+    LockedRegistry locked;
+
+    for (unsigned threads: {1u, 2u, 4u, 8u, 16u, 32u, 64u})
+    {
+        run("shared_mutex", threads, names, [&](string_view s) { return reinterpret_cast<size_t>(locked.get(s)); });
+        run("NameRegistry", threads, names, [](string_view s) { return Name(s).hash(); });
+    }
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+// Compares the hand-written number parsers with the Boost.Spirit based ones they replaced.
+
+#include "number_parsers.h"
+
+#include <boost/spirit/include/qi.hpp>
+#include <boost/spirit/include/phoenix_core.hpp>
+#include <boost/spirit/include/phoenix_operator.hpp>
+#include <boost/fusion/include/std_tuple.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+using namespace fastfood;
+
+namespace {
+    namespace qi = boost::spirit::qi;
+    namespace ns = boost::spirit::standard;
+
+    using component_time = std::tuple<long, long>;
+
+    template <typename Iterator, typename Skipper = qi::space_type>
+    struct ComponentTimeGramar: qi::grammar<Iterator, component_time(), Skipper>
+    {
+        ComponentTimeGramar() : ComponentTimeGramar::base_type(t, "component_time")
+        {
+            t %= ns::no_case[boost::spirit::long_ > "msecs" > boost::spirit::long_ > "usecs"];
+        }
+
+        qi::rule<Iterator, component_time(), Skipper> t;
+    };
+
+    const ComponentTimeGramar<string_view::const_iterator> s_component_time_parser;
+
+    bool spirit_time(string_view s, double& res)
+    {
+        component_time t;
+
+        if (!qi::phrase_parse(s.begin(), s.end(), s_component_time_parser[boost::phoenix::ref(t) = qi::_1], ns::space))
+            return false;
+
+        res = double(std::get<0>(t)) + double(std::get<1>(t)) / 1000.0;
+        return true;
+    }
+
+    bool spirit_double(string_view s, double& res)
+    {
+        return qi::phrase_parse(s.begin(), s.end(), boost::spirit::double_[boost::phoenix::ref(res) = qi::_1], ns::space);
+    }
+
+    bool spirit_long(string_view s, long& res)
+    {
+        return qi::phrase_parse(s.begin(), s.end(), boost::spirit::long_[boost::phoenix::ref(res) = qi::_1], ns::space);
+    }
+
+    template<class T, class Parse>
+    void run(const char *name, const std::vector<std::string>& inputs, Parse parse)
+    {
+        constexpr int Rounds = 1000;
+
+        T sum{};
+        size_t failed = 0;
+
+        const auto start = std::chrono::steady_clock::now();
+
+        for (int r = 0; r < Rounds; ++r)
+        {
+            for (auto& s: inputs)
+            {
+                T v{};
+                if (parse(string_view{s}, v))
+                    sum += v;
+                else
+                    ++failed;
+            }
+        }
+
+        const auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        std::printf("%-24s %8.2f ns/value  (checksum %g, failed %zu)\n",
+            name, elapsed / (inputs.size() * Rounds), double(sum), failed);
+    }
+}
+
+int main()
+{
+    constexpr size_t Count = 10000;
+
+    std::mt19937_64 rng(42);
+    std::vector<std::string> doubles, longs, times;
+    char buf[64];
+
+    for (size_t i = 0; i < Count; ++i)
+    {
+        // Values as they appear in Timing and Counters entries
+        std::snprintf(buf, sizeof(buf), "%.3f", double(rng() % 10000000) / 1000.0);
+        doubles.emplace_back(buf);
+
+        std::snprintf(buf, sizeof(buf), "%lu", static_cast<unsigned long>(rng() % 100000));
+        longs.emplace_back(buf);
+
+        std::snprintf(buf, sizeof(buf), "%lu msecs %lu usecs", static_cast<unsigned long>(rng() % 100000), static_cast<unsigned long>(rng() % 1000));
+        times.emplace_back(buf);
+    }
+
+    run<double>("spirit double_", doubles, spirit_double);
+    run<double>("parse_double", doubles, [](string_view s, double& v) { return parse_double(s, v) == ParseStatus::ok; });
+
+    run<long>("spirit long_", longs, spirit_long);
+    run<long>("parse_long", longs, [](string_view s, long& v) { return parse_long(s, v) == ParseStatus::ok; });
+
+    run<double>("spirit component time", times, spirit_time);
+    run<double>("parse_component_time", times, [](string_view s, double& v) { return parse_component_time(s, v) == ParseStatus::ok; });
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+// Compares hash_string with boost::hash_range that was used for string_view before, and the lookups of many keys
+// in a table that doesn't fit the cache one by one with the batched FlatTable::find_many.
+
+#include "flat_hash.h"
+#include "string_hash.h"
+
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+
+using namespace fastfood;
+
+namespace {
+    using string_view = boost::string_ref;
+
+    template<class F>
+    double time_ns(F f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::vector<std::string> make_keys(size_t count, size_t length, std::mt19937_64& rng)
+    {
+        std::vector<std::string> res;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::string s(length, ' ');
+            for (auto& c: s)
+                c = static_cast<char>('a' + rng() % 26);
+            res.push_back(std::move(s));
+        }
+
+        return res;
+    }
+}
+
+int main()
+{
+    constexpr size_t Rounds = 1000;
+
+    std::mt19937_64 rng(42);
+
+    for (size_t length: {4u, 8u, 16u, 32u, 64u, 256u})
+    {
+        const auto keys = make_keys(1000, length, rng);
+        size_t checksum = 0;
+
+        const auto boost_ns = time_ns([&]
+        {
+            for (size_t r = 0; r < Rounds; ++r)
+                for (auto& k: keys)
+                    checksum += boost::hash_range(k.begin(), k.end());
+        });
+
+        const auto fast_ns = time_ns([&]
+        {
+            for (size_t r = 0; r < Rounds; ++r)
+                for (auto& k: keys)
+                    checksum += hash_string(k);
+        });
+
+        std::printf("%3zu bytes: boost::hash_range %7.2f ns, hash_string %6.2f ns  (checksum %zu)\n",
+            length, boost_ns / (Rounds * keys.size()), fast_ns / (Rounds * keys.size()), checksum);
+    }
+
+    // Table of a few millions of names is much bigger than the cache so every lookup misses it
+    constexpr size_t Table_Size = 4 * 1024 * 1024;
+    constexpr size_t Lookups = 1024 * 1024;
+
+    const auto strings = make_keys(Table_Size, 16, rng);
+    FlatHashMap<string_view, size_t, StringHash> table;
+    table.reserve(Table_Size);
+
+    for (size_t i = 0; i < strings.size(); ++i)
+        table.emplace(string_view{strings[i]}, i);
+
+    std::vector<string_view> keys;
+    for (size_t i = 0; i < Lookups; ++i)
+        keys.emplace_back(strings[rng() % strings.size()]);
+
+    std::vector<decltype(table)::const_iterator> found(keys.size());
+    size_t checksum = 0;
+
+    const auto one_by_one_ns = time_ns([&]
+    {
+        for (size_t i = 0; i < keys.size(); ++i)
+            found[i] = table.find(keys[i]);
+    });
+
+    for (auto& it: found)
+        checksum += it->second;
+
+    const auto batched_ns = time_ns([&] { table.find_many(keys.data(), keys.size(), found.begin()); });
+
+    for (auto& it: found)
+        checksum -= it->second;
+
+    std::printf("%zu entries: find %6.2f ns/lookup, find_many %6.2f ns/lookup  (checksum %zu)\n",
+        table.size(), one_by_one_ns / keys.size(), batched_ns / keys.size(), checksum);
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "name.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+
+namespace fastfood {
+
+    // Bump allocator for strings that have to outlive the buffer they were parsed from.
+    // reset() makes all the memory available again without freeing it, so a parser that resets it
+    // per record allocates only until it has seen its largest record.
+    class Arena
+    {
+    public:
+        static constexpr size_t Default_Block_Size = 64 * 1024;
+
+        explicit Arena(size_t block_size = Default_Block_Size): m_blockSize(block_size) {}
+
+        Arena(const Arena&) = delete;
+        Arena& operator= (const Arena&) = delete;
+
+        string_view copy(string_view s)
+        {
+            if (s.empty())
+                return {};
+
+            if (s.size() > m_left)
+                next_block(s.size());
+
+            std::memcpy(m_pos, s.data(), s.size());
+
+            const string_view res{m_pos, s.size()};
+            m_pos += s.size();
+            m_left -= s.size();
+            return res;
+        }
+
+        void reset() noexcept
+        {
+            m_current = 0;
+            m_pos = m_blocks.empty() ? nullptr : m_blocks.front().data.get();
+            m_left = m_blocks.empty() ? 0 : m_blocks.front().size;
+        }
+
+    private:
+        struct Block
+        {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        void next_block(size_t size)
+        {
+            // Blocks are allocated when first needed and are reused after reset
+            while (!m_blocks.empty() && m_current + 1 < m_blocks.size())
+            {
+                auto& b = m_blocks[++m_current];
+                if (b.size >= size)
+                {
+                    m_pos = b.data.get();
+                    m_left = b.size;
+                    return;
+                }
+            }
+
+            const auto block_size = std::max(m_blockSize, size);
+            m_blocks.push_back(Block{std::unique_ptr<char[]>(new char[block_size]), block_size});
+            m_current = m_blocks.size() - 1;
+            m_pos = m_blocks.back().data.get();
+            m_left = block_size;
+        }
+
+        const size_t m_blockSize;
+        std::vector<Block> m_blocks;
+        size_t m_current = 0;
+        char *m_pos = nullptr;
+        size_t m_left = 0;
+    };
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "name.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace fastfood {
+
+    // Positions of the '\n' and '=' characters in a 64 byte block, bit N stands for byte N.
+    struct BlockMasks
+    {
+        uint64_t newlines;
+        uint64_t separators;
+    };
+
+    constexpr size_t Scan_Block_Size = 64;
+
+    namespace detail {
+        inline unsigned count_trailing_zeros(uint64_t x) noexcept { return __builtin_ctzll(x); }
+
+        // `p` must point to at least Scan_Block_Size readable bytes
+        inline BlockMasks scan_full_block(const char *p) noexcept
+        {
+#if defined(__AVX2__)
+            const auto nl = _mm256_set1_epi8('\n');
+            const auto eq = _mm256_set1_epi8('=');
+            const auto lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            const auto hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+
+            auto mask = [](__m256i v) { return static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(v))); };
+
+            return {
+                mask(_mm256_cmpeq_epi8(lo, nl)) | (mask(_mm256_cmpeq_epi8(hi, nl)) << 32),
+                mask(_mm256_cmpeq_epi8(lo, eq)) | (mask(_mm256_cmpeq_epi8(hi, eq)) << 32)
+            };
+#elif defined(__SSE2__)
+            const auto nl = _mm_set1_epi8('\n');
+            const auto eq = _mm_set1_epi8('=');
+
+            BlockMasks res{0, 0};
+
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 16));
+                res.newlines |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)))) << (i * 16);
+                res.separators |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, eq)))) << (i * 16);
+            }
+
+            return res;
+#else
+            BlockMasks res{0, 0};
+
+            for (unsigned i = 0; i < Scan_Block_Size; ++i)
+            {
+                res.newlines |= static_cast<uint64_t>(p[i] == '\n') << i;
+                res.separators |= static_cast<uint64_t>(p[i] == '=') << i;
+            }
+
+            return res;
+#endif
+        }
+
+        inline BlockMasks scan_block(const char *p, const char *end) noexcept
+        {
+            if (static_cast<size_t>(end - p) >= Scan_Block_Size)
+                return scan_full_block(p);
+
+            // Never read past the end of the buffer: it may be the last page of a mapping.
+            char tail[Scan_Block_Size] = {};
+            std::memcpy(tail, p, end - p);
+            return scan_full_block(tail);
+        }
+    }
+
+    // Returns the position just after the first "EOE\n" line at or after `p` or null if there is none.
+    // A line that starts right at `p` is looked at only if `p` is a line start.
+    inline const char *find_record_end(const char *p, const char *end, bool line_start) noexcept
+    {
+        static const char eoe_line[] = "\nEOE\n";
+        constexpr size_t eoe_line_size = sizeof(eoe_line) - 1;
+
+        if (line_start && end - p >= static_cast<std::ptrdiff_t>(eoe_line_size - 1) && std::memcmp(p, eoe_line + 1, eoe_line_size - 1) == 0)
+            return p + eoe_line_size - 1;
+
+        auto found = static_cast<const char *>(::memmem(p, end - p, eoe_line, eoe_line_size));
+        return found ? found + eoe_line_size : nullptr;
+    }
+
+    struct ScannedLine
+    {
+        string_view text;       // without '\n'
+        size_t separator;       // position of the first '=' in `text` or npos
+    };
+
+    // Splits a buffer into lines and finds the first '=' of each line using one pass
+    // of SIMD compares over 64 byte blocks.
+    class LineScanner
+    {
+    public:
+        static constexpr size_t npos = string_view::npos;
+
+        LineScanner() = default;
+        LineScanner(const char *begin, const char *end) noexcept { reset(begin, end); }
+
+        void reset(const char *begin, const char *end) noexcept
+        {
+            m_lineStart = begin;
+            m_end = end;
+            m_separator = nullptr;
+            load(begin);
+        }
+
+        // Start of the first not yet returned line
+        const char *position() const noexcept { return m_lineStart; }
+        const char *end() const noexcept { return m_end; }
+
+        // Returns false when there is no complete ('\n' terminated) line left.
+        // The incomplete tail (if any) starts at position().
+        bool next(ScannedLine& line) noexcept
+        {
+            for (;;)
+            {
+                // Bits of the bytes starting from the line start. The line may have started in a previous block.
+                const auto from = m_lineStart <= m_base ? ~uint64_t{0}
+                    : m_lineStart >= m_base + Scan_Block_Size ? uint64_t{0}
+                    : ~uint64_t{0} << (m_lineStart - m_base);
+                const auto newlines = m_masks.newlines & from;
+
+                if (!m_separator)
+                {
+                    auto separators = m_masks.separators & from;
+                    if (newlines)
+                        separators &= (newlines & (~newlines + 1)) - 1; // only ones before the newline
+
+                    if (separators)
+                        m_separator = m_base + detail::count_trailing_zeros(separators);
+                }
+
+                if (newlines)
+                {
+                    const auto eol = m_base + detail::count_trailing_zeros(newlines);
+
+                    line.text = string_view{m_lineStart, static_cast<size_t>(eol - m_lineStart)};
+                    line.separator = m_separator ? static_cast<size_t>(m_separator - m_lineStart) : npos;
+
+                    m_lineStart = eol + 1;
+                    m_separator = nullptr;
+                    return true;
+                }
+
+                if (m_end - m_base <= static_cast<std::ptrdiff_t>(Scan_Block_Size))
+                    return false;
+
+                load(m_base + Scan_Block_Size);
+            }
+        }
+
+    private:
+        void load(const char *base) noexcept
+        {
+            m_base = base;
+            m_masks = base < m_end ? detail::scan_block(base, m_end) : BlockMasks{0, 0};
+        }
+
+        const char *m_base = nullptr;
+        const char *m_end = nullptr;
+        const char *m_lineStart = nullptr;
+        const char *m_separator = nullptr;
+        BlockMasks m_masks = {0, 0};
+    };
+}
@@ -0,0 +1,481 @@
+#include "decompress.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef FASTFOOD_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef FASTFOOD_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef FASTFOOD_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+
+namespace fastfood {
+    namespace {
+        constexpr size_t Input_Block_Size = 64 * 1024;
+        constexpr size_t Output_Block_Size = 256 * 1024;
+        constexpr size_t Output_Blocks = 4; // decoder can run that many blocks ahead of the reader
+
+        const unsigned char Gzip_Magic[] = {0x1f, 0x8b};
+        const unsigned char Zstd_Magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+        const unsigned char Lz4_Magic[] = {0x04, 0x22, 0x4d, 0x18};
+
+        template<size_t N>
+        bool has_magic(string_view head, const unsigned char (&magic)[N]) noexcept
+        {
+            return head.size() >= N && std::equal(magic, magic + N, reinterpret_cast<const unsigned char *>(head.data()));
+        }
+
+        std::runtime_error decode_error(Compression c, const std::string& msg)
+        {
+            return std::runtime_error(std::string("Can not decode ") + compression_name(c) + " input: " + msg);
+        }
+
+        // Decodes as much as possible from [in, in_end) to [out, out_end) advancing both pointers
+        class Decoder
+        {
+        public:
+            virtual ~Decoder() = default;
+
+            virtual void decode(const char *& in, const char *in_end, char *& out, char *out_end) = 0;
+
+            // True if the input decoded so far ends on a complete gzip member or zstd/lz4 frame
+            virtual bool at_frame_end() const noexcept = 0;
+        };
+
+#ifdef FASTFOOD_HAVE_ZLIB
+        class GzipDecoder final: public Decoder
+        {
+        public:
+            GzipDecoder()
+            {
+                m_stream.zalloc = Z_NULL;
+                m_stream.zfree = Z_NULL;
+                m_stream.opaque = Z_NULL;
+                m_stream.next_in = Z_NULL;
+                m_stream.avail_in = 0;
+
+                // 16 + MAX_WBITS: gzip header and trailer
+                if (inflateInit2(&m_stream, 16 + MAX_WBITS) != Z_OK)
+                    throw decode_error(Compression::gzip, "can not initialize zlib");
+            }
+
+            ~GzipDecoder() { inflateEnd(&m_stream); }
+
+            void decode(const char *& in, const char *in_end, char *& out, char *out_end) override
+            {
+                if (m_ended)
+                {
+                    if (in == in_end)
+                        return;
+
+                    // Next member of a concatenated file
+                    inflateReset(&m_stream);
+                    m_ended = false;
+                }
+
+                m_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in));
+                m_stream.avail_in = static_cast<uInt>(in_end - in);
+                m_stream.next_out = reinterpret_cast<Bytef *>(out);
+                m_stream.avail_out = static_cast<uInt>(out_end - out);
+
+                const auto res = inflate(&m_stream, Z_NO_FLUSH);
+
+                if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR)
+                    throw decode_error(Compression::gzip, m_stream.msg ? m_stream.msg : "corrupted data");
+
+                m_ended = res == Z_STREAM_END;
+
+                in = reinterpret_cast<const char *>(m_stream.next_in);
+                out = reinterpret_cast<char *>(m_stream.next_out);
+            }
+
+            bool at_frame_end() const noexcept override { return m_ended; }
+
+        private:
+            z_stream m_stream;
+            bool m_ended = false;
+        };
+#endif
+
+#ifdef FASTFOOD_HAVE_ZSTD
+        class ZstdDecoder final: public Decoder
+        {
+        public:
+            ZstdDecoder(): m_stream(ZSTD_createDStream())
+            {
+                if (!m_stream)
+                    throw decode_error(Compression::zstd, "can not create a decompression stream");
+            }
+
+            ~ZstdDecoder() { ZSTD_freeDStream(m_stream); }
+
+            void decode(const char *& in, const char *in_end, char *& out, char *out_end) override
+            {
+                ZSTD_inBuffer input{in, static_cast<size_t>(in_end - in), 0};
+                ZSTD_outBuffer output{out, static_cast<size_t>(out_end - out), 0};
+
+                const auto res = ZSTD_decompressStream(m_stream, &output, &input);
+
+                if (ZSTD_isError(res))
+                    throw decode_error(Compression::zstd, ZSTD_getErrorName(res));
+
+                m_ended = res == 0;
+
+                in += input.pos;
+                out += output.pos;
+            }
+
+            bool at_frame_end() const noexcept override { return m_ended; }
+
+        private:
+            ZSTD_DStream *m_stream;
+            bool m_ended = true;
+        };
+#endif
+
+#ifdef FASTFOOD_HAVE_LZ4
+        class Lz4Decoder final: public Decoder
+        {
+        public:
+            Lz4Decoder()
+            {
+                const auto res = LZ4F_createDecompressionContext(&m_context, LZ4F_VERSION);
+                if (LZ4F_isError(res))
+                    throw decode_error(Compression::lz4, LZ4F_getErrorName(res));
+            }
+
+            ~Lz4Decoder() { LZ4F_freeDecompressionContext(m_context); }
+
+            void decode(const char *& in, const char *in_end, char *& out, char *out_end) override
+            {
+                size_t in_size = static_cast<size_t>(in_end - in);
+                size_t out_size = static_cast<size_t>(out_end - out);
+
+                const auto res = LZ4F_decompress(m_context, out, &out_size, in, &in_size, nullptr);
+
+                if (LZ4F_isError(res))
+                    throw decode_error(Compression::lz4, LZ4F_getErrorName(res));
+
+                m_ended = res == 0;
+
+                in += in_size;
+                out += out_size;
+            }
+
+            bool at_frame_end() const noexcept override { return m_ended; }
+
+        private:
+            LZ4F_dctx *m_context = nullptr;
+            bool m_ended = true;
+        };
+#endif
+
+        std::unique_ptr<Decoder> make_decoder(Compression c)
+        {
+            switch (c)
+            {
+#ifdef FASTFOOD_HAVE_ZLIB
+            case Compression::gzip:
+                return std::unique_ptr<Decoder>(new GzipDecoder);
+#endif
+#ifdef FASTFOOD_HAVE_ZSTD
+            case Compression::zstd:
+                return std::unique_ptr<Decoder>(new ZstdDecoder);
+#endif
+#ifdef FASTFOOD_HAVE_LZ4
+            case Compression::lz4:
+                return std::unique_ptr<Decoder>(new Lz4Decoder);
+#endif
+            default:
+                throw std::runtime_error(std::string(compression_name(c)) + " compressed input is not supported by this build");
+            }
+        }
+    }
+
+    namespace detail {
+        class DecompressingStreamBuf final: public std::streambuf
+        {
+        public:
+            DecompressingStreamBuf(std::istream& source, Compression compression)
+            : m_source(source)
+            , m_compression(compression)
+            , m_decoder(make_decoder(compression))
+            , m_blocks(Output_Blocks)
+            {
+                for (auto& b: m_blocks)
+                {
+                    b.data.resize(Output_Block_Size);
+                    m_free.push_back(&b);
+                }
+
+                m_thread = std::thread([this] { run(); });
+            }
+
+            ~DecompressingStreamBuf()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mux);
+                    m_stop = true;
+                }
+                m_cv.notify_all();
+                m_thread.join();
+            }
+
+        protected:
+            int_type underflow() override
+            {
+                if (gptr() < egptr())
+                    return traits_type::to_int_type(*gptr());
+
+                std::unique_lock<std::mutex> lock(m_mux);
+
+                if (m_current)
+                {
+                    m_free.push_back(m_current);
+                    m_current = nullptr;
+                    m_cv.notify_all();
+                }
+
+                m_cv.wait(lock, [this] { return !m_ready.empty() || m_finished; });
+
+                if (m_ready.empty())
+                {
+                    if (m_error)
+                        std::rethrow_exception(m_error);
+                    return traits_type::eof();
+                }
+
+                m_current = m_ready.front();
+                m_ready.pop_front();
+                lock.unlock();
+
+                setg(m_current->data.data(), m_current->data.data(), m_current->data.data() + m_current->size);
+                return traits_type::to_int_type(*gptr());
+            }
+
+        private:
+            struct Block
+            {
+                std::vector<char> data;
+                size_t size = 0;
+            };
+
+            // Decoder thread
+            void run()
+            {
+                try
+                {
+                    std::vector<char> input(Input_Block_Size);
+                    const char *in = input.data(), *in_end = input.data();
+                    bool source_eof = false;
+                    bool done = false;
+
+                    while (!done)
+                    {
+                        Block *block;
+
+                        {
+                            std::unique_lock<std::mutex> lock(m_mux);
+                            m_cv.wait(lock, [this] { return !m_free.empty() || m_stop; });
+                            if (m_stop)
+                                return;
+                            block = m_free.back();
+                            m_free.pop_back();
+                        }
+
+                        char *out = block->data.data();
+                        char *const out_end = out + block->data.size();
+
+                        while (out != out_end)
+                        {
+                            if (in == in_end && !source_eof)
+                            {
+                                m_source.read(input.data(), input.size());
+                                in = input.data();
+                                in_end = in + m_source.gcount();
+                                source_eof = in == in_end;
+                            }
+
+                            const auto prev_in = in;
+                            const auto prev_out = out;
+
+                            m_decoder->decode(in, in_end, out, out_end);
+
+                            if (in == prev_in && out == prev_out)
+                            {
+                                if (!source_eof)
+                                    continue;
+
+                                if (!m_decoder->at_frame_end())
+                                    throw decode_error(m_compression, "unexpected end of input");
+
+                                done = true;
+                                break;
+                            }
+                        }
+
+                        block->size = static_cast<size_t>(out - block->data.data());
+
+                        {
+                            std::lock_guard<std::mutex> lock(m_mux);
+                            if (block->size)
+                                m_ready.push_back(block);
+                            else
+                                m_free.push_back(block);
+                        }
+                        m_cv.notify_all();
+                    }
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(m_mux);
+                    m_error = std::current_exception();
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mux);
+                    m_finished = true;
+                }
+                m_cv.notify_all();
+            }
+
+            std::istream& m_source;
+            const Compression m_compression;
+            std::unique_ptr<Decoder> m_decoder;
+
+            std::vector<Block> m_blocks;
+            Block *m_current = nullptr;     // being read, owned by the reader
+
+            std::mutex m_mux;
+            std::condition_variable m_cv;
+            std::vector<Block *> m_free;    // guarded by m_mux
+            std::deque<Block *> m_ready;    //
+            std::exception_ptr m_error;     //
+            bool m_finished = false;        //
+            bool m_stop = false;            //
+
+            std::thread m_thread;
+        };
+    }
+
+    namespace detail {
+        class PrefixedStreamBuf final: public std::streambuf
+        {
+        public:
+            PrefixedStreamBuf(std::string head, std::streambuf& source)
+            : m_head(std::move(head))
+            , m_source(source)
+            {
+                const auto data = const_cast<char *>(m_head.data());
+                setg(data, data, data + m_head.size());
+            }
+
+        protected:
+            // Once the head is consumed the get area stays empty and characters are taken from the source
+            int_type underflow() override
+            {
+                return gptr() < egptr() ? traits_type::to_int_type(*gptr()) : m_source.sgetc();
+            }
+
+            int_type uflow() override
+            {
+                if (gptr() < egptr())
+                {
+                    const auto c = traits_type::to_int_type(*gptr());
+                    gbump(1);
+                    return c;
+                }
+
+                return m_source.sbumpc();
+            }
+
+            std::streamsize xsgetn(char *s, std::streamsize n) override
+            {
+                const auto from_head = std::min<std::streamsize>(n, egptr() - gptr());
+
+                std::copy(gptr(), gptr() + from_head, s);
+                gbump(static_cast<int>(from_head));
+
+                return from_head == n ? n : from_head + m_source.sgetn(s + from_head, n - from_head);
+            }
+
+        private:
+            const std::string m_head;
+            std::streambuf& m_source;
+        };
+    }
+
+    const char *compression_name(Compression c) noexcept
+    {
+        switch (c)
+        {
+        case Compression::none: return "uncompressed";
+        case Compression::gzip: return "gzip";
+        case Compression::zstd: return "zstd";
+        case Compression::lz4: return "lz4";
+        }
+
+        return "unknown";
+    }
+
+    Compression detect_compression(string_view head) noexcept
+    {
+        if (has_magic(head, Gzip_Magic))
+            return Compression::gzip;
+        if (has_magic(head, Zstd_Magic))
+            return Compression::zstd;
+        if (has_magic(head, Lz4_Magic))
+            return Compression::lz4;
+        return Compression::none;
+    }
+
+    Compression detect_compression(std::istream& is, std::string& head)
+    {
+        head.clear();
+
+        const auto c = is.peek();
+        if (c != Gzip_Magic[0] && c != Zstd_Magic[0] && c != Lz4_Magic[0])
+            return Compression::none;
+
+        head.resize(std::max({sizeof(Gzip_Magic), sizeof(Zstd_Magic), sizeof(Lz4_Magic)}));
+        is.read(&head[0], head.size());
+        head.resize(static_cast<size_t>(is.gcount()));
+
+        // Whatever was read, it's returned by the stream again
+        if (is.eof())
+            is.clear(is.rdstate() & ~(std::ios_base::eofbit | std::ios_base::failbit));
+
+        return detect_compression(head);
+    }
+
+    PrefixedStream::PrefixedStream(std::string head, std::istream& source)
+    : std::istream(nullptr)
+    , m_buf(new detail::PrefixedStreamBuf(std::move(head), *source.rdbuf()))
+    {
+        rdbuf(m_buf.get());
+    }
+
+    PrefixedStream::~PrefixedStream() = default;
+
+    DecompressingStream::DecompressingStream(std::istream& source, Compression compression)
+    : std::istream(nullptr)
+    , m_buf(new detail::DecompressingStreamBuf(source, compression))
+    {
+        rdbuf(m_buf.get());
+    }
+
+    DecompressingStream::~DecompressingStream() = default;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "name.h"
+#include <istream>
+#include <memory>
+#include <string>
+
+
+namespace fastfood {
+
+    enum class Compression { none, gzip, zstd, lz4 };
+
+    const char *compression_name(Compression c) noexcept;
+
+    // Detects a compressed input by the magic bytes at its beginning
+    Compression detect_compression(string_view head) noexcept;
+
+    // Same for a stream that can't be rewound. The first byte is peeked and, only if a magic may start with it,
+    // the bytes of the magic are read into `head`. The input is then `head` followed by the rest of the stream,
+    // see PrefixedStream.
+    Compression detect_compression(std::istream& is, std::string& head);
+
+    namespace detail {
+        class DecompressingStreamBuf;
+        class PrefixedStreamBuf;
+    }
+
+    // Reads `head` and then the rest of `source`. Reads of a block go straight to the source
+    // so the data is not copied on the way.
+    class PrefixedStream: public std::istream
+    {
+    public:
+        PrefixedStream(std::string head, std::istream& source);
+        ~PrefixedStream();
+
+    private:
+        std::unique_ptr<detail::PrefixedStreamBuf> m_buf;
+    };
+
+    // Decodes a compressed stream on a dedicated thread into blocks that are handed over to the reader,
+    // so decoding overlaps with parsing. Reading copies the decoded data out of the blocks like reading
+    // any other stream does. Concatenated gzip members and zstd/lz4 frames are decoded one after another.
+    // Errors of the decoder are rethrown by the reading operations.
+    class DecompressingStream: public std::istream
+    {
+    public:
+        DecompressingStream(std::istream& source, Compression compression);
+        ~DecompressingStream();
+
+    private:
+        std::unique_ptr<detail::DecompressingStreamBuf> m_buf;
+    };
+}
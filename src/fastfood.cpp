@@ -1,8 +1,12 @@
 #include "fql.h"
 #include "recs_parser.h"
+#include "scan.h"
+#include "input_files.h"
+#include "follow.h"
+#include <boost/program_options.hpp>
 #include <iostream>
-#include <fstream>
 #include <sstream>
+#include <thread>
 /*
  Performance improving ideas:
  - ? For field names instead of the string use unique id (of size_t type) that's hashed to itself or string + precalculated hash
@@ -11,55 +15,92 @@
 
 
 using namespace fastfood;
+namespace po = boost::program_options;
 
 
 int main(int argc, char *argv[])
 {
     try
     {
-        if (argc <= 1)
-            throw std::runtime_error("Usage: fastfood <query> [<filename>]");
+        std::string queryStr;
+        std::vector<std::string> inputs;
+        std::string schemaFile;
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+        po::options_description options("Options");
+        options.add_options()
+            ("help,h", "show this help")
+            ("threads,j", po::value<unsigned>(&threads)->default_value(threads), "number of threads to parse with")
+            ("unordered,u", "print records of multiple files a chunk at a time in the order the chunks are done (faster)")
+            ("follow,f", "keep reading the file as it grows and follow it when it's rotated")
+            ("stats", "print the evaluation order chosen for the filter to stderr when done")
+            ("schema,s", po::value<std::string>(&schemaFile), "file declaring field types, a '<field or glob> <string|double|int|count|time>' per line")
+        ;
+
+        po::options_description hidden;
+        hidden.add_options()
+            ("query", po::value<std::string>(&queryStr))
+            ("input", po::value<std::vector<std::string>>(&inputs))
+        ;
+
+        po::positional_options_description positional;
+        positional.add("query", 1).add("input", -1);
+
+        po::options_description all;
+        all.add(options).add(hidden);
+
+        po::variables_map vm;
+        po::store(po::command_line_parser(argc, argv).options(all).positional(positional).run(), vm);
+        po::notify(vm);
+
+        if (threads == 0)
+            throw std::runtime_error("The number of threads must be at least 1");
+
+        if (vm.count("help") || !vm.count("query"))
+        {
+            std::ostringstream usage;
+            usage << "Usage: fastfood [options] <query> [<file, directory or glob>...]\n"
+                  << "Reads stdin if no input is given.\n"
+                  << options;
 
-        auto query = fql::parse_query(argv[1]);
+            if (vm.count("help"))
+            {
+                std::cout << usage.str();
+                return 0;
+            }
 
-        FieldSet interestingFields;
+            throw std::runtime_error(usage.str());
+        }
 
-        interestingFields.insert(begin(query.m_fields), end(query.m_fields));
-        query.m_where->visit_fields([&interestingFields](Name f) { interestingFields.insert(f); });
+        FieldTypes fieldTypes;
+        if (!schemaFile.empty())
+            fieldTypes = FieldTypes::load(schemaFile);
 
-        std::ifstream input_file;
-        std::istream *is = &std::cin;
+        const ScanQuery query{fql::parse_query(queryStr), &fieldTypes};
+        const auto filenames = expand_inputs(inputs);
 
-        if (argc > 1)
+        if (query.never_matches())
         {
-            const std::string inputFilename(argv[2]);
-            input_file.open(inputFilename, std::ios_base::binary);
-            if (!input_file)
-                throw std::runtime_error("Can not open file '" + inputFilename + "'");
-            is = &input_file;
+            // Nothing can match so there is nothing to read
         }
-
-
-        RecsParser parser(*is, interestingFields);
-
-        while (parser.next())
+        else if (vm.count("follow"))
         {
-            const auto& currentRecord = parser.current();
+            if (filenames.size() != 1)
+                throw std::runtime_error("Can not follow other than exactly one file");
 
-            if (query.m_where->match(currentRecord))
-            {
-                // Do something with current record
-                for (auto&& r: currentRecord)
-                {
-                    if (!r.second.which())
-                        continue;
-
-                    std::cout << r.first.str() << ": ";
-                    boost::apply_visitor(RecordPrinter{std::cout}, r.second);
-                    std::cout << "\n";
-                }
-                std::cout << "\n";
-            }
+            follow_file(filenames.front(), query, std::cout);
+        }
+        else if (inputs.empty())
+            scan_stream(std::cin, query, std::cout);
+        else if (filenames.size() == 1)
+            scan_file(filenames.front(), query, threads, std::cout);
+        else
+            scan_files(filenames, query, threads, vm.count("unordered") ? OutputOrder::unordered : OutputOrder::ordered, std::cout);
+
+        if (vm.count("stats"))
+        {
+            std::cout.flush();
+            query.print_stats(std::cerr);
         }
     }
     catch (const std::exception& ex)
@@ -69,4 +110,4 @@ int main(int argc, char *argv[])
     }
 
     return 0;
-}
\ No newline at end of file
+}
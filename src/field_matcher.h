@@ -0,0 +1,134 @@
+#pragma once
+
+#include "types.h"
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+
+namespace fastfood {
+
+    // Maps raw strings of a fixed set of keys to values.
+    // Lookups never take a lock or allocate, so rejecting a key that is not in the set costs
+    // a length check and a few word compares.
+    template<class T>
+    class BasicFieldMatcher
+    {
+    public:
+        // `key` must outlive the matcher
+        T& add(string_view key)
+        {
+            if (auto v = find(key))
+                return *const_cast<T *>(v);
+
+            if (key.size() >= m_buckets.size())
+                m_buckets.resize(key.size() + 1);
+
+            m_buckets[key.size()].push_back(Entry{prefix(key), key.data(), T{}});
+            return m_buckets[key.size()].back().value;
+        }
+
+        // Returns null if `key` is not in the set
+        const T *find(string_view key) const noexcept
+        {
+            if (key.size() >= m_buckets.size())
+                return nullptr;
+
+            const auto p = prefix(key);
+
+            for (auto&& e: m_buckets[key.size()])
+            {
+                if (e.prefix == p && std::memcmp(e.data, key.data(), key.size()) == 0)
+                    return &e.value;
+            }
+
+            return nullptr;
+        }
+
+        bool empty() const noexcept { return m_buckets.empty(); }
+
+    private:
+        struct Entry
+        {
+            uint64_t prefix;
+            const char *data;
+            T value;
+        };
+
+        // First (up to) 8 bytes of the key, compared before the whole key
+        static uint64_t prefix(string_view s) noexcept
+        {
+            uint64_t res = 0;
+            std::memcpy(&res, s.data(), std::min<size_t>(s.size(), sizeof(res)));
+            return res;
+        }
+
+        std::vector<std::vector<Entry>> m_buckets; // by key length
+    };
+
+    // Finds the schema slot of a raw field name.
+    // Unlike constructing a Name it never looks into the NameRegistry or interns anything.
+    class FieldMatcher: public BasicFieldMatcher<size_t>
+    {
+    public:
+        FieldMatcher() = default;
+
+        explicit FieldMatcher(const RecordSchema& schema)
+        {
+            for (size_t slot = 0; slot < schema.size(); ++slot)
+                add(schema.name(slot)) = slot;
+        }
+    };
+
+    // Slots of the interesting fields an entry of a 'Timing' line expands to: timer-<key>-time and timer-<key>-count
+    struct TimerFields
+    {
+        optional<size_t> time;
+        optional<size_t> count;
+    };
+
+    // Slot of the interesting field an entry of a 'Counters' line expands to: counter-<key>-value
+    struct CounterFields
+    {
+        optional<size_t> value;
+    };
+
+    // Interesting Timing and Counters entries by their keys i.e. by the names as they are written in the line
+    class SubFieldMatcher
+    {
+    public:
+        SubFieldMatcher() = default;
+
+        explicit SubFieldMatcher(const RecordSchema& schema)
+        {
+            for (size_t slot = 0; slot < schema.size(); ++slot)
+            {
+                const auto f = schema.name(slot).str();
+                string_view key;
+
+                if (extract_key(f, "timer-", "-time", key))
+                    m_timers.add(key).time = slot;
+                else if (extract_key(f, "timer-", "-count", key))
+                    m_timers.add(key).count = slot;
+                else if (extract_key(f, "counter-", "-value", key))
+                    m_counters.add(key).value = slot;
+            }
+        }
+
+        const BasicFieldMatcher<TimerFields>& timers() const noexcept { return m_timers; }
+        const BasicFieldMatcher<CounterFields>& counters() const noexcept { return m_counters; }
+
+    private:
+        static bool extract_key(string_view name, string_view prefix, string_view suffix, string_view& key) noexcept
+        {
+            if (name.size() < prefix.size() + suffix.size() || !name.starts_with(prefix) || !name.ends_with(suffix))
+                return false;
+
+            key = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+            return true;
+        }
+
+        BasicFieldMatcher<TimerFields> m_timers;
+        BasicFieldMatcher<CounterFields> m_counters;
+    };
+}
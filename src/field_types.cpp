@@ -0,0 +1,92 @@
+#include "field_types.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <fnmatch.h>
+
+
+namespace fastfood {
+    namespace {
+        bool is_pattern(const std::string& s)
+        {
+            return s.find_first_of("*?[") != std::string::npos;
+        }
+
+        bool parse_kind(const std::string& s, FieldKind& kind)
+        {
+            if (s == "string")
+                kind = FieldKind::string;
+            else if (s == "double")
+                kind = FieldKind::double_;
+            else if (s == "int")
+                kind = FieldKind::int64;
+            else if (s == "count")
+                kind = FieldKind::count;
+            else if (s == "time")
+                kind = FieldKind::time;
+            else
+                return false;
+
+            return true;
+        }
+    }
+
+    FieldTypes FieldTypes::load(const std::string& filename)
+    {
+        std::ifstream file(filename);
+        if (!file)
+            throw std::runtime_error("Can not open schema file '" + filename + "'");
+
+        return read(file, filename);
+    }
+
+    FieldTypes FieldTypes::read(std::istream& is, const std::string& source)
+    {
+        FieldTypes res;
+        std::string line;
+
+        for (size_t line_no = 1; std::getline(is, line); ++line_no)
+        {
+            std::istringstream words(line);
+            std::string pattern, type, rest;
+
+            if (!(words >> pattern) || pattern.front() == '#')
+                continue;
+
+            FieldKind kind;
+
+            if (!(words >> type) || (words >> rest) || !parse_kind(type, kind))
+            {
+                throw std::runtime_error("Can not parse schema file '" + source + "' line " + std::to_string(line_no)
+                    + ": expected '<field or pattern> <string|double|int|count|time>'");
+            }
+
+            res.add(std::move(pattern), kind);
+        }
+
+        return res;
+    }
+
+    void FieldTypes::add(std::string pattern, FieldKind kind)
+    {
+        const auto glob = is_pattern(pattern);
+        m_declarations.push_back(Declaration{std::move(pattern), glob, kind});
+    }
+
+    bool FieldTypes::find(string_view name, FieldKind& kind) const
+    {
+        const auto name_str = name.to_string();
+
+        for (auto& d: m_declarations)
+        {
+            if (d.is_pattern ? ::fnmatch(d.pattern.c_str(), name_str.c_str(), 0) == 0 : d.pattern == name_str)
+            {
+                kind = d.kind;
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+
+namespace fastfood {
+
+    // Field kinds declared by the user instead of guessed from the names.
+    // A schema file has a declaration per line: a field name or a glob pattern (*, ? or [...]) and a type,
+    // one of string, double, int, count (non-negative int) or time ("<msecs> msecs <usecs> usecs").
+    // Empty lines and lines starting with '#' are ignored. The first matching declaration wins.
+    class FieldTypes
+    {
+    public:
+        static FieldTypes load(const std::string& filename);
+
+        // Reads declarations from the stream, `source` names it in errors
+        static FieldTypes read(std::istream& is, const std::string& source);
+
+        void add(std::string pattern, FieldKind kind);
+
+        // Returns false if the field is not declared
+        bool find(string_view name, FieldKind& kind) const;
+
+        bool empty() const noexcept { return m_declarations.empty(); }
+
+    private:
+        struct Declaration
+        {
+            std::string pattern;
+            bool is_pattern;
+            FieldKind kind;
+        };
+
+        std::vector<Declaration> m_declarations;   // in the order of the file
+    };
+}
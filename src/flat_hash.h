@@ -0,0 +1,483 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace fastfood {
+    namespace detail {
+
+        // Open addressing hash table in the style of Swiss tables: slots are split into groups of 16,
+        // each slot has a control byte that is Ctrl_Empty, Ctrl_Deleted or 7 bits of the key hash.
+        // A lookup compares the control bytes of a whole group with the hash bits at once and
+        // looks at the slots of the matching bytes only. Groups are probed quadratically.
+        // Erase leaves a tombstone (Ctrl_Deleted) so the probing of the keys inserted past the slot still
+        // finds them; tombstones are reused by insertion and dropped by a rehash.
+        template<class Slot, class Key, class KeyOf, class Hash, class Equal>
+        class FlatTable
+        {
+        public:
+            static constexpr size_t Group_Size = 16;
+
+            template<class SlotRef, class SlotPtr>
+            class basic_iterator
+            {
+            public:
+                using value_type = Slot;
+                using reference = SlotRef;
+                using pointer = SlotPtr;
+                using difference_type = std::ptrdiff_t;
+                using iterator_category = std::forward_iterator_tag;
+
+                basic_iterator() = default;
+                basic_iterator(const int8_t *ctrl, const int8_t *ctrl_end, SlotPtr slot) noexcept
+                : m_ctrl(ctrl), m_ctrlEnd(ctrl_end), m_slot(slot)
+                {
+                    skip_empty();
+                }
+
+                // iterator -> const_iterator
+                template<class R, class P>
+                basic_iterator(const basic_iterator<R, P>& r) noexcept
+                : m_ctrl(r.m_ctrl), m_ctrlEnd(r.m_ctrlEnd), m_slot(r.m_slot) {}
+
+                reference operator* () const noexcept { return *m_slot; }
+                pointer operator-> () const noexcept { return m_slot; }
+
+                basic_iterator& operator++ () noexcept
+                {
+                    ++m_ctrl;
+                    ++m_slot;
+                    skip_empty();
+                    return *this;
+                }
+
+                basic_iterator operator++ (int) noexcept
+                {
+                    auto res = *this;
+                    ++*this;
+                    return res;
+                }
+
+                bool operator== (const basic_iterator& r) const noexcept { return m_ctrl == r.m_ctrl; }
+                bool operator!= (const basic_iterator& r) const noexcept { return m_ctrl != r.m_ctrl; }
+
+            private:
+                template<class, class> friend class basic_iterator;
+                friend class FlatTable;
+
+                // Skips empty slots and tombstones
+                void skip_empty() noexcept
+                {
+                    while (m_ctrl != m_ctrlEnd && *m_ctrl < 0)
+                    {
+                        ++m_ctrl;
+                        ++m_slot;
+                    }
+                }
+
+                const int8_t *m_ctrl = nullptr;
+                const int8_t *m_ctrlEnd = nullptr;
+                SlotPtr m_slot = nullptr;
+            };
+
+            using iterator = basic_iterator<Slot&, Slot *>;
+            using const_iterator = basic_iterator<const Slot&, const Slot *>;
+
+            FlatTable() = default;
+
+            FlatTable(const FlatTable& r)
+            {
+                reserve(r.size());
+                for (auto& s: r)
+                    insert_new(s);
+            }
+
+            FlatTable(FlatTable&& r) noexcept { swap(r); }
+
+            FlatTable& operator= (FlatTable r) noexcept
+            {
+                swap(r);
+                return *this;
+            }
+
+            ~FlatTable() { destroy(); }
+
+            void swap(FlatTable& r) noexcept
+            {
+                std::swap(m_groups, r.m_groups);
+                std::swap(m_slots, r.m_slots);
+                std::swap(m_capacity, r.m_capacity);
+                std::swap(m_size, r.m_size);
+                std::swap(m_tombstones, r.m_tombstones);
+            }
+
+            size_t size() const noexcept { return m_size; }
+            bool empty() const noexcept { return m_size == 0; }
+
+            iterator begin() noexcept { return {ctrl(), ctrl() + m_capacity, m_slots}; }
+            iterator end() noexcept { return {ctrl() + m_capacity, ctrl() + m_capacity, m_slots + m_capacity}; }
+            const_iterator begin() const noexcept { return {ctrl(), ctrl() + m_capacity, m_slots}; }
+            const_iterator end() const noexcept { return {ctrl() + m_capacity, ctrl() + m_capacity, m_slots + m_capacity}; }
+
+            iterator find(const Key& key) noexcept
+            {
+                const auto i = find_index(key, Hash()(key));
+                return i == npos ? end() : iterator{ctrl() + i, ctrl() + m_capacity, m_slots + i};
+            }
+
+            const_iterator find(const Key& key) const noexcept
+            {
+                return const_cast<FlatTable *>(this)->find(key);
+            }
+
+            // Lookup with a hash computed beforehand by Hash
+            const_iterator find(const Key& key, size_t hash) const noexcept
+            {
+                const auto i = find_index(key, hash);
+                return i == npos ? end() : const_iterator{ctrl() + i, ctrl() + m_capacity, m_slots + i};
+            }
+
+            // Asks the CPU to load the first group a lookup of the hash looks at
+            void prefetch(size_t hash) const noexcept
+            {
+#if defined(__GNUC__)
+                if (!m_capacity)
+                    return;
+
+                const auto group = h1(mix(hash)) & (m_capacity / Group_Size - 1);
+                __builtin_prefetch(ctrl() + group * Group_Size);
+                __builtin_prefetch(m_slots + group * Group_Size);
+#else
+                (void)hash;
+#endif
+            }
+
+            // Looks up `count` keys writing an iterator per key to `out`. Keys are hashed and their groups
+            // are prefetched a batch ahead of the lookups so the cache misses of a batch overlap.
+            template<class OutputIt>
+            void find_many(const Key *keys, size_t count, OutputIt out) const
+            {
+                constexpr size_t Batch_Size = 16;
+                size_t hashes[Batch_Size];
+
+                for (size_t first = 0; first < count; first += Batch_Size)
+                {
+                    const auto n = std::min(Batch_Size, count - first);
+
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        hashes[i] = Hash()(keys[first + i]);
+                        prefetch(hashes[i]);
+                    }
+
+                    for (size_t i = 0; i < n; ++i)
+                        *out++ = find(keys[first + i], hashes[i]);
+                }
+            }
+
+            size_t count(const Key& key) const noexcept { return find_index(key, Hash()(key)) != npos; }
+
+            template<class... Args>
+            std::pair<iterator, bool> emplace(Args&&... args)
+            {
+                Slot slot(std::forward<Args>(args)...);
+                const auto hash = Hash()(KeyOf()(slot));
+                const auto i = find_index(KeyOf()(slot), hash);
+
+                if (i != npos)
+                    return {iterator{ctrl() + i, ctrl() + m_capacity, m_slots + i}, false};
+
+                const auto j = insert_new(std::move(slot), hash);
+                return {iterator{ctrl() + j, ctrl() + m_capacity, m_slots + j}, true};
+            }
+
+            void reserve(size_t n)
+            {
+                if (n > max_size_for(m_capacity))
+                    rehash(capacity_for(n));
+            }
+
+            // Returns the number of slots erased (0 or 1)
+            size_t erase(const Key& key)
+            {
+                const auto i = find_index(key, Hash()(key));
+                if (i == npos)
+                    return 0;
+
+                m_slots[i].~Slot();
+                ctrl()[i] = Ctrl_Deleted;
+                --m_size;
+                ++m_tombstones;
+                return 1;
+            }
+
+            // Returns the iterator following the erased one
+            iterator erase(const_iterator pos)
+            {
+                const auto i = static_cast<size_t>(pos.m_ctrl - ctrl());
+
+                m_slots[i].~Slot();
+                ctrl()[i] = Ctrl_Deleted;
+                --m_size;
+                ++m_tombstones;
+                return {ctrl() + i + 1, ctrl() + m_capacity, m_slots + i + 1};
+            }
+
+            void clear() noexcept
+            {
+                destroy();
+                m_groups.reset();
+                m_capacity = 0;
+                m_size = 0;
+                m_tombstones = 0;
+            }
+
+        private:
+            static constexpr size_t npos = static_cast<size_t>(-1);
+            static constexpr int8_t Ctrl_Empty = -128;
+            static constexpr int8_t Ctrl_Deleted = -2;   // a tombstone, full slots have non-negative bytes
+
+            // Bitmask of the slots of a group whose control bytes are equal to a value
+            static uint32_t match(const int8_t *group, int8_t value) noexcept
+            {
+#if defined(__SSE2__)
+                const auto bytes = _mm_load_si128(reinterpret_cast<const __m128i *>(group));
+                return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(value))));
+#else
+                uint32_t res = 0;
+                for (size_t i = 0; i < Group_Size; ++i)
+                    res |= uint32_t(group[i] == value) << i;
+                return res;
+#endif
+            }
+
+            static unsigned lowest_bit(uint32_t mask) noexcept
+            {
+#if defined(__GNUC__)
+                return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+                unsigned res = 0;
+                while (!(mask & 1))
+                {
+                    mask >>= 1;
+                    ++res;
+                }
+                return res;
+#endif
+            }
+
+            // Hashes of consecutive integers (e.g. name ids) must be spread over all the bits
+            static uint64_t mix(uint64_t h) noexcept
+            {
+                h ^= h >> 33;
+                h *= 0xff51afd7ed558ccdULL;
+                h ^= h >> 33;
+                return h;
+            }
+
+            static int8_t h2(uint64_t h) noexcept { return static_cast<int8_t>(h & 0x7f); }
+            static size_t h1(uint64_t h) noexcept { return static_cast<size_t>(h >> 7); }
+
+            static size_t max_size_for(size_t capacity) noexcept { return capacity - capacity / 8; }
+
+            static size_t capacity_for(size_t n) noexcept
+            {
+                size_t capacity = Group_Size;
+                while (max_size_for(capacity) < n)
+                    capacity *= 2;
+                return capacity;
+            }
+
+            size_t find_index(const Key& key, size_t hash) const noexcept
+            {
+                if (!m_capacity)
+                    return npos;
+
+                const auto h = mix(hash);
+                const auto group_mask = m_capacity / Group_Size - 1;
+                auto group = h1(h) & group_mask;
+
+                for (size_t step = 1;; ++step)
+                {
+                    const auto group_ctrl = ctrl() + group * Group_Size;
+
+                    for (auto m = match(group_ctrl, h2(h)); m; m &= m - 1)
+                    {
+                        const auto i = group * Group_Size + lowest_bit(m);
+                        if (Equal()(KeyOf()(m_slots[i]), key))
+                            return i;
+                    }
+
+                    if (match(group_ctrl, Ctrl_Empty))
+                        return npos;
+
+                    group = (group + step) & group_mask;
+                }
+            }
+
+            // Bitmask of the slots of a group that are empty or tombstones
+            static uint32_t match_free(const int8_t *group) noexcept
+            {
+#if defined(__SSE2__)
+                const auto bytes = _mm_load_si128(reinterpret_cast<const __m128i *>(group));
+                return static_cast<uint32_t>(_mm_movemask_epi8(bytes));
+#else
+                uint32_t res = 0;
+                for (size_t i = 0; i < Group_Size; ++i)
+                    res |= uint32_t(group[i] < 0) << i;
+                return res;
+#endif
+            }
+
+            // The key must not be in the table
+            size_t insert_new(Slot slot, size_t hash)
+            {
+                // Tombstones count against the load as they lengthen probing just like full slots.
+                // If there are many of them the rehash cleans them up without growing.
+                if (m_size + m_tombstones + 1 > max_size_for(m_capacity))
+                    rehash(capacity_for(m_size + 1));
+
+                const auto h = mix(hash);
+                const auto group_mask = m_capacity / Group_Size - 1;
+                auto group = h1(h) & group_mask;
+
+                for (size_t step = 1;; ++step)
+                {
+                    const auto group_ctrl = ctrl() + group * Group_Size;
+
+                    if (const auto free = match_free(group_ctrl))
+                    {
+                        const auto i = group * Group_Size + lowest_bit(free);
+
+                        ::new (static_cast<void *>(m_slots + i)) Slot(std::move(slot));
+                        m_tombstones -= ctrl()[i] == Ctrl_Deleted;
+                        ctrl()[i] = h2(h);
+                        ++m_size;
+                        return i;
+                    }
+
+                    group = (group + step) & group_mask;
+                }
+            }
+
+            size_t insert_new(const Slot& slot) { return insert_new(Slot(slot), Hash()(KeyOf()(slot))); }
+
+            void rehash(size_t capacity)
+            {
+                FlatTable table;
+                table.allocate(capacity);
+
+                for (size_t i = 0; i < m_capacity; ++i)
+                {
+                    if (ctrl()[i] >= 0)
+                    {
+                        // The key must be hashed before the slot is moved from
+                        const auto hash = Hash()(KeyOf()(m_slots[i]));
+                        table.insert_new(std::move(m_slots[i]), hash);
+                    }
+                }
+
+                swap(table);
+            }
+
+            void allocate(size_t capacity)
+            {
+                m_groups.reset(new Group[capacity / Group_Size]);
+                std::memset(ctrl(), Ctrl_Empty, capacity);
+                m_slots = std::allocator<Slot>().allocate(capacity);
+                m_capacity = capacity;
+            }
+
+            void destroy() noexcept
+            {
+                if (!m_slots)
+                    return;
+
+                for (size_t i = 0; i < m_capacity; ++i)
+                {
+                    if (ctrl()[i] >= 0)
+                        m_slots[i].~Slot();
+                }
+
+                std::allocator<Slot>().deallocate(m_slots, m_capacity);
+                m_slots = nullptr;
+            }
+
+            // Control bytes are loaded a group at a time with aligned loads
+            struct alignas(Group_Size) Group { int8_t ctrl[Group_Size]; };
+
+            int8_t *ctrl() const noexcept { return m_groups ? m_groups[0].ctrl : nullptr; }
+
+            std::unique_ptr<Group[]> m_groups;
+            Slot *m_slots = nullptr;
+            size_t m_capacity = 0;
+            size_t m_size = 0;
+            size_t m_tombstones = 0;
+        };
+
+        template<class Key>
+        struct SetKeyOf
+        {
+            const Key& operator() (const Key& k) const noexcept { return k; }
+        };
+
+        template<class Key, class Value>
+        struct MapKeyOf
+        {
+            const Key& operator() (const std::pair<Key, Value>& p) const noexcept { return p.first; }
+        };
+    }
+
+    // Drop-in replacements for std::unordered_set/map in the hot paths.
+    // Unlike the std containers insertion invalidates iterators and references.
+    template<class Key, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+    class FlatHashSet: public detail::FlatTable<Key, Key, detail::SetKeyOf<Key>, Hash, Equal>
+    {
+        using Base = detail::FlatTable<Key, Key, detail::SetKeyOf<Key>, Hash, Equal>;
+
+    public:
+        using value_type = Key;
+
+        FlatHashSet() = default;
+
+        template<class InputIt>
+        FlatHashSet(InputIt first, InputIt last)
+        {
+            for (; first != last; ++first)
+                insert(*first);
+        }
+
+        FlatHashSet(std::initializer_list<Key> keys): FlatHashSet(keys.begin(), keys.end()) {}
+
+        std::pair<typename Base::iterator, bool> insert(const Key& key) { return this->emplace(key); }
+    };
+
+    template<class Key, class Value, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+    class FlatHashMap: public detail::FlatTable<std::pair<Key, Value>, Key, detail::MapKeyOf<Key, Value>, Hash, Equal>
+    {
+    public:
+        using key_type = Key;
+        using mapped_type = Value;
+        using value_type = std::pair<Key, Value>;
+
+        Value& operator[] (const Key& key)
+        {
+            auto it = this->find(key);
+            if (it == this->end())
+                it = this->emplace(key, Value{}).first;
+            return it->second;
+        }
+    };
+}
@@ -0,0 +1,229 @@
+#include "follow.h"
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace fastfood {
+    namespace {
+        constexpr size_t Read_Block_Size = 4 * 1024 * 1024;
+
+        std::runtime_error system_error(const std::string& msg)
+        {
+            return std::runtime_error(msg + ": " + std::strerror(errno));
+        }
+
+        // Returns the position just after the last complete record in the buffer or 0 if there is none
+        size_t last_record_end(string_view buffer) noexcept
+        {
+            static const string_view eoe_line{"\nEOE\n"};
+
+            const auto pos = buffer.rfind(eoe_line);
+
+            if (pos != string_view::npos)
+                return pos + eoe_line.size();
+
+            return buffer.starts_with(eoe_line.substr(1)) ? eoe_line.size() - 1 : 0;
+        }
+
+        class Follower
+        {
+        public:
+            Follower(const std::string& filename, const ScanQuery& query, std::ostream& os)
+            : m_filename(filename)
+            , m_query(query)
+            , m_os(os)
+            , m_inotify(::inotify_init1(IN_CLOEXEC))
+            {
+                if (m_inotify < 0)
+                    throw system_error("Can not initialize inotify");
+
+                // Rotation is noticed by the directory events, appends by the file ones
+                auto dir = boost::filesystem::path(filename).parent_path().string();
+                if (dir.empty())
+                    dir = ".";
+
+                if (::inotify_add_watch(m_inotify, dir.c_str(), IN_CREATE | IN_MOVED_TO) < 0)
+                    throw system_error("Can not watch directory '" + dir + "'");
+
+                open();
+            }
+
+            ~Follower()
+            {
+                if (m_fd >= 0)
+                    ::close(m_fd);
+                ::close(m_inotify);
+            }
+
+            void run()
+            {
+                for (;;)
+                {
+                    read_available();
+
+                    if (rotated())
+                    {
+                        // Whatever was written to the old file before the rotation is still there
+                        read_available();
+                        drop_pending("the end of rotated file");
+                        ::close(m_fd);
+                        m_fd = -1;
+                        open();
+                        continue;
+                    }
+
+                    wait();
+                }
+            }
+
+        private:
+            void open()
+            {
+                m_fd = ::open(m_filename.c_str(), O_RDONLY | O_CLOEXEC);
+                if (m_fd < 0)
+                    throw system_error("Can not open file '" + m_filename + "'");
+
+                if (m_fileWatch >= 0)
+                    ::inotify_rm_watch(m_inotify, m_fileWatch);
+
+                m_fileWatch = ::inotify_add_watch(m_inotify, m_filename.c_str(), IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF);
+                if (m_fileWatch < 0)
+                    throw system_error("Can not watch file '" + m_filename + "'");
+
+                m_offset = 0;
+                m_pendingSize = 0;
+            }
+
+            // A record the writer has not completed won't be completed anymore
+            void drop_pending(const char *where)
+            {
+                if (m_pendingSize)
+                    std::cerr << "Warning: skipped an incomplete record of " << m_pendingSize << " bytes at "
+                              << where << " '" << m_filename << "'\n";
+
+                m_pendingSize = 0;
+            }
+
+            // True if the name refers to another file now
+            bool rotated() const
+            {
+                struct stat current, opened;
+
+                if (::stat(m_filename.c_str(), &current) != 0 || ::fstat(m_fd, &opened) != 0)
+                    return false; // moved away but not created yet, wait for it
+
+                return current.st_ino != opened.st_ino || current.st_dev != opened.st_dev;
+            }
+
+            // Reads everything appended since the last call and scans the complete records of it
+            void read_available()
+            {
+                struct stat st;
+                if (::fstat(m_fd, &st) == 0 && static_cast<uint64_t>(st.st_size) < m_offset)
+                {
+                    // Truncated in place
+                    drop_pending("the beginning of truncated file");
+                    m_offset = 0;
+                }
+
+                for (;;)
+                {
+                    reserve_pending(m_pendingSize + Read_Block_Size);
+
+                    const auto n = ::pread(m_fd, m_pending.get() + m_pendingSize, Read_Block_Size, static_cast<off_t>(m_offset));
+
+                    if (n < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        throw system_error("Can not read file '" + m_filename + "'");
+                    }
+
+                    m_pendingSize += static_cast<size_t>(n);
+                    m_offset += n;
+
+                    scan_complete_records();
+
+                    if (n == 0)
+                        return;
+                }
+            }
+
+            // Grows the buffer keeping the pending data. The memory is left uninitialized, it's read into right away.
+            void reserve_pending(size_t capacity)
+            {
+                if (capacity <= m_pendingCapacity)
+                    return;
+
+                const auto new_capacity = std::max(capacity, m_pendingCapacity * 2);
+                std::unique_ptr<char[]> buffer(new char[new_capacity]);
+                std::memcpy(buffer.get(), m_pending.get(), m_pendingSize);
+
+                m_pending = std::move(buffer);
+                m_pendingCapacity = new_capacity;
+            }
+
+            void scan_complete_records()
+            {
+                const auto end = last_record_end(string_view{m_pending.get(), m_pendingSize});
+
+                if (end == 0)
+                    return;
+
+                scan_buffer(string_view{m_pending.get(), end}, m_query, m_os);
+                m_os.flush();
+
+                std::memmove(m_pending.get(), m_pending.get() + end, m_pendingSize - end);
+                m_pendingSize -= end;
+            }
+
+            // Blocks until something happens to the file or the directory
+            void wait()
+            {
+                pollfd pfd{m_inotify, POLLIN, 0};
+
+                while (::poll(&pfd, 1, -1) < 0)
+                {
+                    if (errno != EINTR)
+                        throw system_error("Can not wait for inotify events");
+                }
+
+                // The events themselves don't matter: the file is checked for new data and rotation anyway
+                alignas(inotify_event) char events[64 * (sizeof(inotify_event) + NAME_MAX + 1)];
+
+                if (::read(m_inotify, events, sizeof(events)) < 0 && errno != EINTR)
+                    throw system_error("Can not read inotify events");
+            }
+
+            const std::string m_filename;
+            const ScanQuery& m_query;
+            std::ostream& m_os;
+
+            int m_inotify;
+            int m_fileWatch = -1;
+            int m_fd = -1;
+            uint64_t m_offset = 0;                  // of the end of the pending data in the file
+            std::unique_ptr<char[]> m_pending;      // not yet scanned data, starts at a record boundary
+            size_t m_pendingSize = 0;
+            size_t m_pendingCapacity = 0;
+        };
+    }
+
+    void follow_file(const std::string& filename, const ScanQuery& query, std::ostream& os)
+    {
+        Follower follower(filename, query, os);
+        follower.run();
+    }
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "scan.h"
+#include <iosfwd>
+#include <string>
+
+
+namespace fastfood {
+
+    // Scans a growing recs file and keeps waiting (with inotify) for more records to be appended, never returns
+    // unless an error happens. The file is scanned from its beginning, not from its end as it was when called.
+    // Only complete records i.e. ones up to the last "EOE" line are parsed, the rest is parsed when it's completed.
+    // When the file is rotated (moved or removed and then created again under the same name) the rest of the old
+    // file is scanned and the new file is scanned from its beginning. A file truncated in place is scanned again
+    // from its beginning. An incomplete record left at the end of a rotated or truncated file is skipped
+    // with a warning.
+    void follow_file(const std::string& filename, const ScanQuery& query, std::ostream& os);
+}
@@ -0,0 +1,69 @@
+#include "input_files.h"
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <stdexcept>
+#include <glob.h>
+
+
+namespace fastfood {
+    namespace fs = boost::filesystem;
+
+    namespace {
+        bool is_glob(const std::string& s)
+        {
+            return s.find_first_of("*?[") != std::string::npos;
+        }
+
+        void expand_glob(const std::string& pattern, std::vector<std::string>& res)
+        {
+            glob_t matches;
+            const auto rc = ::glob(pattern.c_str(), 0, nullptr, &matches);
+
+            if (rc == GLOB_NOMATCH)
+                throw std::runtime_error("No files match '" + pattern + "'");
+
+            if (rc != 0)
+            {
+                ::globfree(&matches);
+                throw std::runtime_error("Can not expand '" + pattern + "'");
+            }
+
+            for (size_t i = 0; i < matches.gl_pathc; ++i)
+                res.emplace_back(matches.gl_pathv[i]);
+
+            ::globfree(&matches);
+        }
+
+        void expand_directory(const std::string& dir, std::vector<std::string>& res)
+        {
+            std::vector<std::string> files;
+
+            for (fs::directory_iterator it(dir), end; it != end; ++it)
+            {
+                if (fs::is_regular_file(it->status()))
+                    files.push_back(it->path().string());
+            }
+
+            std::sort(files.begin(), files.end());
+            res.insert(res.end(), files.begin(), files.end());
+        }
+    }
+
+    std::vector<std::string> expand_inputs(const std::vector<std::string>& inputs)
+    {
+        std::vector<std::string> res;
+
+        for (auto& i: inputs)
+        {
+            if (is_glob(i) && !fs::exists(i))
+                expand_glob(i, res);
+            else if (fs::is_directory(i))
+                expand_directory(i, res);
+            else
+                res.push_back(i);
+        }
+
+        return res;
+    }
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+namespace fastfood {
+
+    // Expands command line inputs to the list of files to read:
+    // - a glob pattern (*, ? or [...]) expands to the matching paths in sorted order,
+    // - a directory expands to the regular files in it (not recursively) in sorted order,
+    // - anything else is taken as is.
+    std::vector<std::string> expand_inputs(const std::vector<std::string>& inputs);
+}
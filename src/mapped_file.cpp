@@ -0,0 +1,87 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+namespace fastfood {
+    namespace {
+        std::runtime_error file_error(const std::string& msg, const std::string& filename)
+        {
+            return std::runtime_error(msg + " '" + filename + "': " + std::strerror(errno));
+        }
+    }
+
+    MappedFile::MappedFile(const std::string& filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw file_error("Can not open file", filename);
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            auto err = file_error("Can not stat file", filename);
+            ::close(fd);
+            throw err;
+        }
+
+        m_size = static_cast<size_t>(st.st_size);
+
+        // mmap does not accept zero length so an empty file is represented by an empty view
+        if (m_size != 0)
+        {
+            auto p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                auto err = file_error("Can not map file", filename);
+                ::close(fd);
+                throw err;
+            }
+
+            m_data = static_cast<const char *>(p);
+
+            // The parser makes a single forward pass over the data
+            ::madvise(p, m_size, MADV_SEQUENTIAL);
+        }
+
+        ::close(fd);
+    }
+
+    MappedFile::~MappedFile()
+    {
+        if (m_data)
+            ::munmap(const_cast<char *>(m_data), m_size);
+    }
+
+    bool MappedFile::is_mappable(const std::string& filename) noexcept
+    {
+        size_t size;
+        return is_mappable(filename, size);
+    }
+
+    bool MappedFile::is_mappable(const std::string& filename, size_t& size) noexcept
+    {
+        struct stat st;
+        if (::stat(filename.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            return false;
+
+        size = static_cast<size_t>(st.st_size);
+        return true;
+    }
+
+    void MappedFile::prefetch(const std::string& filename) noexcept
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        ::close(fd);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "name.h"
+#include <string>
+
+
+namespace fastfood {
+
+    // Read-only memory mapping of a whole regular file.
+    // The mapped bytes stay valid (and string_views into them too) for the lifetime of the object.
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& filename);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator= (const MappedFile&) = delete;
+
+        string_view data() const noexcept { return {m_data, m_size}; }
+        size_t size() const noexcept { return m_size; }
+
+        // Returns true if `filename` names a regular file i.e. a file that can be mapped.
+        static bool is_mappable(const std::string& filename) noexcept;
+
+        // Same, also returns the size of the file if it's mappable
+        static bool is_mappable(const std::string& filename, size_t& size) noexcept;
+
+        // Asks the kernel to start reading the file into the page cache. Errors are ignored.
+        static void prefetch(const std::string& filename) noexcept;
+
+    private:
+        const char *m_data = nullptr;
+        size_t m_size = 0;
+    };
+}
@@ -1,7 +1,75 @@
 #include "name.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
 
 namespace fastfood { namespace detail {
+    constexpr size_t NameArena::Block_Size;
+
     NameRegistry NameRegistry::s_instance;
-    const std::string NameRegistry::s_emptyStr;
+    const NameEntry NameRegistry::s_empty{string_view{""}, 0};
+    thread_local const NameEntry *NameRegistry::s_cache[NameRegistry::Cache_Size];
+
+    const NameEntry *NameArena::add(string_view s, uint32_t id)
+    {
+        const auto size = sizeof(NameEntry) + s.size();
+        const auto padding = reinterpret_cast<uintptr_t>(m_pos) % alignof(NameEntry);
+        const auto needed = size + (padding ? alignof(NameEntry) - padding : 0);
+
+        if (needed > m_left)
+        {
+            // Blocks come from new[] so they are suitably aligned
+            const auto block_size = std::max(Block_Size, size);
+            m_blocks.emplace_back(new char[block_size]);
+            m_pos = m_blocks.back().get();
+            m_left = block_size;
+        }
+        else if (padding)
+        {
+            m_pos += alignof(NameEntry) - padding;
+            m_left -= alignof(NameEntry) - padding;
+        }
+
+        auto chars = m_pos + sizeof(NameEntry);
+        std::memcpy(chars, s.data(), s.size());
+
+        auto entry = new (m_pos) NameEntry{string_view{chars, s.size()}, id};
+
+        m_pos += size;
+        m_left -= size;
+        return entry;
+    }
+
+    const NameEntry *NameRegistry::find_or_add(string_view s, size_t hash)
+    {
+        // Low bits of the hash select the cache slot so use other ones for the shard
+        auto& shard = m_shards[(hash / Cache_Size) % Shard_Count];
+
+        {
+            boost::shared_lock<boost::shared_mutex> read_lock(shard.mux);
+
+            auto it = shard.entries.find(s);
+            if (it != shard.entries.end())
+                return it->second;
+        }
+
+        std::lock_guard<boost::shared_mutex> write_lock(shard.mux);
+
+        // Might be added by another thread while the lock was released
+        auto it = shard.entries.find(s);
+        if (it != shard.entries.end())
+            return it->second;
+
+        if (m_nextId.load(std::memory_order_relaxed) == std::numeric_limits<uint32_t>::max())
+            throw std::runtime_error("Can not intern more names");
+
+        auto entry = shard.arena.add(s, m_nextId.fetch_add(1, std::memory_order_release));
+        shard.entries.emplace(entry->str, entry);
+        return entry;
+    }
 }}
@@ -1,23 +1,22 @@
 #pragma once
 
+#include "flat_hash.h"
+#include "string_hash.h"
+#include <atomic>
+#include <cstdint>
 #include <string>
-#include <unordered_map>
 #include <memory>
 #include <functional>
+#include <vector>
 #include <iosfwd>
 #include <boost/utility/string_ref.hpp>
-#include <boost/functional/hash.hpp>
 #include <boost/thread/shared_mutex.hpp>
 
 
-// Old versions of Boost don't have it. TODO: ifndef for newer Boost versions
 namespace std {
     template<>
     struct hash<boost::string_ref> {
-        size_t operator() (const boost::string_ref& s) const noexcept
-        {
-            return boost::hash_range(s.begin(), s.end());
-        }
+        size_t operator() (const boost::string_ref& s) const noexcept { return fastfood::hash_string(s); }
     };
 }
 
@@ -28,61 +27,97 @@ namespace fastfood {
     class Name;
 
     namespace detail {
+        // Interned name. Entries are never freed so pointers to them stay valid until the program exits.
+        struct NameEntry
+        {
+            string_view str;
+            uint32_t id;    // dense, assigned in order of interning starting with 0 for the empty name
+        };
+
+        // Bump allocator for the entries and their characters
+        class NameArena
+        {
+        public:
+            const NameEntry *add(string_view s, uint32_t id);
+
+        private:
+            static constexpr size_t Block_Size = 16 * 1024;
+
+            std::vector<std::unique_ptr<char[]>> m_blocks;
+            char *m_pos = nullptr;
+            size_t m_left = 0;
+        };
+
+        // Names are looked up in a per-thread cache first so the lookup of a name that was already seen
+        // by the thread touches no memory shared with other threads. Misses go to one of the shards
+        // of the registry, each one with its own lock, map and arena.
         class NameRegistry
         {
             friend class fastfood::Name;
 
             static NameRegistry& instance() { return s_instance; }
 
-            static const std::string *emptyStr() { return &s_emptyStr; }
+            static const NameEntry *empty() { return &s_empty; }
 
-            const std::string *get(string_view s)
+            const NameEntry *get(string_view s)
             {
                 if (s.empty())
-                    return emptyStr();
+                    return empty();
+
+                const auto hash = std::hash<string_view>()(s);
+                auto& cached = s_cache[hash % Cache_Size];
 
-                boost::shared_lock<boost::shared_mutex> read_lock(m_mux);
+                if (!cached || cached->str != s)
+                    cached = find_or_add(s, hash);
 
-                auto it = m_strings.find(s);
+                return cached;
+            }
 
-                if (it != m_strings.end())
-                    return it->second.get();
+            const NameEntry *find_or_add(string_view s, size_t hash);
 
-                // Add entry
-                read_lock.unlock();
-                boost::unique_lock<boost::shared_mutex> write_lock(m_mux);
+            uint32_t id_limit() const noexcept { return m_nextId.load(std::memory_order_acquire); }
 
-                std::unique_ptr<std::string> entry(new std::string{s.to_string()});
-                auto res = entry.get();
-                m_strings.emplace(string_view{*res}, std::move(entry));
-                return res;
-            }
+            static constexpr size_t Shard_Count = 64;
+            static constexpr size_t Cache_Size = 1024;
 
-            boost::shared_mutex m_mux;
-            std::unordered_map<string_view, std::unique_ptr<std::string>> m_strings;
+            struct alignas(64) Shard
+            {
+                boost::shared_mutex mux;
+                FlatHashMap<string_view, const NameEntry *> entries;
+                NameArena arena;
+            };
+
+            Shard m_shards[Shard_Count];
+            alignas(64) std::atomic<uint32_t> m_nextId{1};
 
             static NameRegistry s_instance;
-            static const std::string s_emptyStr;
+            static const NameEntry s_empty;
+            static thread_local const NameEntry *s_cache[Cache_Size];
         };
     }
 
     class Name
     {
     public:
-        Name(): m_impl(detail::NameRegistry::emptyStr()) {}
+        Name(): m_impl(detail::NameRegistry::empty()) {}
         explicit Name(string_view op): m_impl(detail::NameRegistry::instance().get(op)) {}
 
-        size_t hash() const noexcept { return std::hash<const std::string *>()(m_impl); }
+        // Small unique number of the name, good for indexing arrays and bitsets by name
+        uint32_t id() const noexcept { return m_impl->id; }
+
+        // All the names interned so far have ids less than this
+        static uint32_t id_limit() noexcept { return detail::NameRegistry::instance().id_limit(); }
+
+        size_t hash() const noexcept { return m_impl->id; }
 
-        const std::string& str() const noexcept { return *m_impl; }
-        operator const std::string& () const noexcept { return str(); }
+        string_view str() const noexcept { return m_impl->str; }
         operator string_view () const noexcept { return str(); }
 
         inline bool operator!= (const Name& r) const noexcept { return m_impl != r.m_impl; }
         inline bool operator== (const Name& r) const noexcept { return m_impl == r.m_impl; }
 
     private:
-        const std::string *m_impl;
+        const detail::NameEntry *m_impl;
     };
 
     inline bool operator!= (const Name& l, const string_view& r) noexcept { return l.str() != r; }
@@ -0,0 +1,177 @@
+#pragma once
+
+#include "name.h"
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+
+/*
+ Non-throwing number parsers for the recs values.
+
+ All of them skip leading and trailing spaces and require the rest of the input to be consumed.
+ */
+
+
+namespace fastfood {
+
+    enum class ParseStatus { ok, invalid, out_of_range };
+
+    namespace detail {
+        inline bool is_space(char c) noexcept { return c == ' ' || (c >= '\t' && c <= '\r'); }
+        inline bool is_digit(char c) noexcept { return static_cast<unsigned char>(c - '0') < 10; }
+
+        inline void skip_spaces(const char *& p, const char *end) noexcept
+        {
+            while (p != end && is_space(*p))
+                ++p;
+        }
+
+        inline uint64_t load_8_bytes(const char *p) noexcept
+        {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        // True if all 8 (little endian) bytes are '0'..'9'
+        inline bool is_8_digits(uint64_t v) noexcept
+        {
+            return !(((v & 0xF0F0F0F0F0F0F0F0u) | (((v + 0x0606060606060606u) & 0xF0F0F0F0F0F0F0F0u) >> 4)) ^ 0x3333333333333333u);
+        }
+
+        // Converts 8 ASCII digits (little endian) to the number without a branch per digit
+        inline uint32_t parse_8_digits(uint64_t v) noexcept
+        {
+            v -= 0x3030303030303030u;
+            v = (v * 10) + (v >> 8);
+            v = (((v & 0x000000FF000000FFu) * 0x000F424000000064u) + (((v >> 16) & 0x000000FF000000FFu) * 0x0000271000000001u)) >> 32;
+            return static_cast<uint32_t>(v);
+        }
+
+        // Accumulates decimal digits to `value` while it fits 19 digits. Returns the number of digits consumed.
+        inline size_t parse_digits(const char *& p, const char *end, uint64_t& value) noexcept
+        {
+            const auto start = p;
+
+            while (end - p >= 8 && is_8_digits(load_8_bytes(p)))
+            {
+                value = value * 100000000 + parse_8_digits(load_8_bytes(p));
+                p += 8;
+            }
+
+            while (p != end && is_digit(*p))
+            {
+                value = value * 10 + static_cast<unsigned char>(*p - '0');
+                ++p;
+            }
+
+            return static_cast<size_t>(p - start);
+        }
+
+        inline bool match_no_case(const char *& p, const char *end, string_view word) noexcept
+        {
+            if (static_cast<size_t>(end - p) < word.size())
+                return false;
+
+            for (size_t i = 0; i < word.size(); ++i)
+                if ((p[i] | 0x20) != word[i])
+                    return false;
+
+            p += word.size();
+            return true;
+        }
+
+        // Parses an optionally signed integer from [p, end) without skipping spaces
+        inline ParseStatus parse_long_prefix(const char *& p, const char *end, long& res) noexcept
+        {
+            bool negative = false;
+
+            if (p != end && (*p == '-' || *p == '+'))
+            {
+                negative = *p == '-';
+                ++p;
+            }
+
+            uint64_t value = 0;
+            const auto start = p;
+            auto digits = parse_digits(p, end, value);
+
+            if (digits == 0)
+                return ParseStatus::invalid;
+
+            // 19 digits never overflow uint64_t, one more significant digit always overflows long
+            if (digits > 19)
+            {
+                auto q = start;
+                while (q != p && *q == '0')
+                    ++q;
+
+                if (p - q > 19)
+                    return ParseStatus::out_of_range;
+            }
+
+            const auto limit = static_cast<uint64_t>(std::numeric_limits<long>::max()) + negative;
+            if (value > limit)
+                return ParseStatus::out_of_range;
+
+            res = negative ? static_cast<long>(0 - value) : static_cast<long>(value);
+            return ParseStatus::ok;
+        }
+    }
+
+    inline ParseStatus parse_long(string_view s, long& res) noexcept
+    {
+        auto p = s.begin(), end = s.end();
+
+        detail::skip_spaces(p, end);
+
+        const auto status = detail::parse_long_prefix(p, end, res);
+        if (status != ParseStatus::ok)
+            return status;
+
+        detail::skip_spaces(p, end);
+        return p == end ? ParseStatus::ok : ParseStatus::invalid;
+    }
+
+    // Eisel-Lemire algorithm with the exact fast path for small mantissas and exponents.
+    // Falls back to strtod only for mantissas longer than 19 digits that can't be rounded unambiguously.
+    ParseStatus parse_double(string_view s, double& res) noexcept;
+
+    // Parses "<N> msecs <M> usecs" (case insensitive) to N + M / 1000 milliseconds in one pass
+    inline ParseStatus parse_component_time(string_view s, double& msecs) noexcept
+    {
+        auto p = s.begin(), end = s.end();
+        long ms, us;
+
+        detail::skip_spaces(p, end);
+
+        auto status = detail::parse_long_prefix(p, end, ms);
+        if (status != ParseStatus::ok)
+            return status;
+
+        detail::skip_spaces(p, end);
+
+        if (!detail::match_no_case(p, end, "msecs"))
+            return ParseStatus::invalid;
+
+        detail::skip_spaces(p, end);
+
+        status = detail::parse_long_prefix(p, end, us);
+        if (status != ParseStatus::ok)
+            return status;
+
+        detail::skip_spaces(p, end);
+
+        if (!detail::match_no_case(p, end, "usecs"))
+            return ParseStatus::invalid;
+
+        detail::skip_spaces(p, end);
+
+        if (p != end)
+            return ParseStatus::invalid;
+
+        msecs = double(ms) + double(us) / 1000.0;
+        return ParseStatus::ok;
+    }
+}
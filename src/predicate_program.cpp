@@ -0,0 +1,289 @@
+#include "predicate_program.h"
+
+#include <ostream>
+#include <stdexcept>
+
+
+namespace fastfood {
+    namespace {
+        using OpCode = PredicateProgram::OpCode;
+        using Instruction = PredicateProgram::Instruction;
+        using Operands = PredicateProgram::Operands;
+
+        // Several instructions of a program share a cache line
+        static_assert(sizeof(Instruction) <= 5 * sizeof(uint32_t), "an instruction must not hold its operands");
+
+        // Jump targets are labels while compiling and are resolved to positions at the end
+        class Compiler final: public PredicateVisitor
+        {
+        public:
+            static constexpr uint32_t Match_Label = 0;
+            static constexpr uint32_t No_Match_Label = 1;
+
+            Compiler(std::vector<Instruction>& code, Operands& operands): m_code(code), m_operands(operands), m_labels(2) {}
+
+            void compile(const Predicate& predicate)
+            {
+                compile(predicate, Match_Label, No_Match_Label);
+
+                m_labels[Match_Label] = static_cast<uint32_t>(m_code.size());
+                m_labels[No_Match_Label] = static_cast<uint32_t>(m_code.size() + 1);
+
+                for (auto& i: m_code)
+                {
+                    i.on_true = m_labels[i.on_true];
+                    i.on_false = m_labels[i.on_false];
+                }
+            }
+
+            void visit_true() override
+            {
+                emit(OpCode::true_, 0, 0);
+            }
+
+            void visit_comparison(Name field, size_t slot, CompOp op, double val) override
+            {
+                emit(static_cast<OpCode>(static_cast<uint8_t>(OpCode::number_eq) + static_cast<uint8_t>(op)),
+                     checked_slot(field, slot), add(m_operands.numbers, val));
+            }
+
+            void visit_comparison(Name field, size_t slot, CompOp op, string_view val) override
+            {
+                emit(static_cast<OpCode>(static_cast<uint8_t>(OpCode::string_eq) + static_cast<uint8_t>(op)),
+                     checked_slot(field, slot), add(m_operands.strings, val));
+            }
+
+            void visit_range(Name field, size_t slot, double lo, bool lo_inclusive, double hi, bool hi_inclusive) override
+            {
+                emit(OpCode::number_range, checked_slot(field, slot),
+                     add(m_operands.ranges, PredicateProgram::Range{lo, hi, lo_inclusive, hi_inclusive}));
+            }
+
+            void visit_set(Name field, size_t slot, const FlatHashSet<double>& values) override
+            {
+                emit(OpCode::number_in, checked_slot(field, slot), add(m_operands.number_sets, &values));
+            }
+
+            void visit_set(Name field, size_t slot, const FlatHashSet<string_view>& values) override
+            {
+                emit(OpCode::string_in, checked_slot(field, slot), add(m_operands.string_sets, &values));
+            }
+
+            void visit_or(const std::vector<PredicatePtr>& predicates) override
+            {
+                // An empty OR never matches
+                if (predicates.empty())
+                {
+                    emit(OpCode::true_, 0, 0).on_true = m_onFalse;
+                    return;
+                }
+
+                // A passed child matches the whole OR, a failed one passes to the next child
+                const auto on_true = m_onTrue, on_false = m_onFalse;
+                for (size_t i = 0; i + 1 < predicates.size(); ++i)
+                {
+                    const auto next = new_label();
+                    compile(*predicates[i], on_true, next);
+                    bind_label(next);
+                }
+                compile(*predicates.back(), on_true, on_false);
+            }
+
+            void visit_and(const std::vector<PredicatePtr>& predicates) override
+            {
+                if (predicates.empty())
+                    return visit_true();
+
+                const auto on_true = m_onTrue, on_false = m_onFalse;
+                for (size_t i = 0; i + 1 < predicates.size(); ++i)
+                {
+                    const auto next = new_label();
+                    compile(*predicates[i], next, on_false);
+                    bind_label(next);
+                }
+                compile(*predicates.back(), on_true, on_false);
+            }
+
+        private:
+            void compile(const Predicate& predicate, uint32_t on_true, uint32_t on_false)
+            {
+                m_onTrue = on_true;
+                m_onFalse = on_false;
+                predicate.accept(*this);
+            }
+
+            Instruction& emit(OpCode op, uint32_t slot, uint32_t operand)
+            {
+                m_code.push_back(Instruction{slot, m_onTrue, m_onFalse, operand, op});
+                return m_code.back();
+            }
+
+            // Returns the index of the operand in the table
+            template<class T>
+            static uint32_t add(std::vector<T>& table, const T& val)
+            {
+                table.push_back(val);
+                return static_cast<uint32_t>(table.size() - 1);
+            }
+
+            static uint32_t checked_slot(Name field, size_t slot)
+            {
+                if (slot == RecordSchema::npos)
+                    throw std::runtime_error("Can not compile predicate: field '" + field.str().to_string() + "' is not bound");
+
+                return static_cast<uint32_t>(slot);
+            }
+
+            uint32_t new_label()
+            {
+                m_labels.push_back(0);
+                return static_cast<uint32_t>(m_labels.size() - 1);
+            }
+
+            void bind_label(uint32_t label) noexcept
+            {
+                m_labels[label] = static_cast<uint32_t>(m_code.size());
+            }
+
+            std::vector<Instruction>& m_code;
+            Operands& m_operands;
+            std::vector<uint32_t> m_labels;     // label -> position
+            uint32_t m_onTrue = Match_Label;
+            uint32_t m_onFalse = No_Match_Label;
+        };
+
+        const char *op_name(OpCode op) noexcept
+        {
+            static const char *const names[] = {
+                "true",
+                "num ==", "num !=", "num <", "num <=", "num >", "num >=",
+                "str ==", "str !=", "str <", "str <=", "str >", "str >=",
+                "num range", "num in", "str in",
+            };
+            return names[static_cast<uint8_t>(op)];
+        }
+    }
+
+    PredicateProgram::PredicateProgram(const Predicate& predicate)
+    {
+        Compiler(m_code, m_operands).compile(predicate);
+        m_shape = find_shape(m_code);
+
+        if (m_shape == Shape::all_2 || m_shape == Shape::any_2)
+            m_pairKernel = pair_kernel(m_shape == Shape::all_2, m_code[0].op, m_code[1].op);
+    }
+
+    bool PredicateProgram::typed_kernel() const noexcept
+    {
+        return m_pairKernel && m_pairKernel != match_all<2> && m_pairKernel != match_any<2>;
+    }
+
+    template<bool All, PredicateProgram::OpCode First>
+    PredicateProgram::Kernel PredicateProgram::pair_kernel(OpCode second) noexcept
+    {
+        switch (second)
+        {
+        case OpCode::number_eq:
+            return All ? match_all_2<First, OpCode::number_eq> : match_any_2<First, OpCode::number_eq>;
+        case OpCode::number_ne:
+            return All ? match_all_2<First, OpCode::number_ne> : match_any_2<First, OpCode::number_ne>;
+        case OpCode::number_lt:
+            return All ? match_all_2<First, OpCode::number_lt> : match_any_2<First, OpCode::number_lt>;
+        case OpCode::number_le:
+            return All ? match_all_2<First, OpCode::number_le> : match_any_2<First, OpCode::number_le>;
+        case OpCode::number_gt:
+            return All ? match_all_2<First, OpCode::number_gt> : match_any_2<First, OpCode::number_gt>;
+        case OpCode::number_ge:
+            return All ? match_all_2<First, OpCode::number_ge> : match_any_2<First, OpCode::number_ge>;
+        case OpCode::string_eq:
+            return All ? match_all_2<First, OpCode::string_eq> : match_any_2<First, OpCode::string_eq>;
+        default:
+            return All ? match_all<2> : match_any<2>;
+        }
+    }
+
+    PredicateProgram::Kernel PredicateProgram::pair_kernel(bool all, OpCode first, OpCode second) noexcept
+    {
+        // Kernels are instantiated for the comparisons of the single comparison kernels only,
+        // a pair of any other tests switches on each of them
+        switch (first)
+        {
+        case OpCode::number_eq:
+            return all ? pair_kernel<true, OpCode::number_eq>(second) : pair_kernel<false, OpCode::number_eq>(second);
+        case OpCode::number_ne:
+            return all ? pair_kernel<true, OpCode::number_ne>(second) : pair_kernel<false, OpCode::number_ne>(second);
+        case OpCode::number_lt:
+            return all ? pair_kernel<true, OpCode::number_lt>(second) : pair_kernel<false, OpCode::number_lt>(second);
+        case OpCode::number_le:
+            return all ? pair_kernel<true, OpCode::number_le>(second) : pair_kernel<false, OpCode::number_le>(second);
+        case OpCode::number_gt:
+            return all ? pair_kernel<true, OpCode::number_gt>(second) : pair_kernel<false, OpCode::number_gt>(second);
+        case OpCode::number_ge:
+            return all ? pair_kernel<true, OpCode::number_ge>(second) : pair_kernel<false, OpCode::number_ge>(second);
+        case OpCode::string_eq:
+            return all ? pair_kernel<true, OpCode::string_eq>(second) : pair_kernel<false, OpCode::string_eq>(second);
+        default:
+            return all ? match_all<2> : match_any<2>;
+        }
+    }
+
+    PredicateProgram::Shape PredicateProgram::find_shape(const std::vector<Instruction>& code) noexcept
+    {
+        // An AND of comparisons, however nested, compiles to tests that go to the next one when passed
+        // and to no match when failed, the last one goes to match. An OR is the other way round.
+        const auto size = code.size();
+        if (size == 0 || size > Max_Kernel_Size)
+            return Shape::generic;
+
+        bool all = true, any = true;
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            const auto next = pc + 1 == size ? size : pc + 1;
+            all = all && code[pc].on_true == next && code[pc].on_false == size + 1;
+            any = any && code[pc].on_true == size && code[pc].on_false == (pc + 1 == size ? size + 1 : pc + 1);
+        }
+
+        if (all && size == 1 && code[0].op >= OpCode::number_eq && code[0].op <= OpCode::number_ge)
+            return static_cast<Shape>(static_cast<uint8_t>(Shape::number_eq)
+                                      + static_cast<uint8_t>(code[0].op) - static_cast<uint8_t>(OpCode::number_eq));
+        if (all && size == 1 && code[0].op == OpCode::string_eq)
+            return Shape::string_eq;
+        if (all)
+            return static_cast<Shape>(static_cast<uint8_t>(Shape::all_1) + size - 1);
+        if (any)
+            return static_cast<Shape>(static_cast<uint8_t>(Shape::any_2) + size - 2);
+        return Shape::generic;
+    }
+
+    std::ostream& PredicateProgram::print(std::ostream& os) const
+    {
+        const auto target = [this](uint32_t pc) -> std::string {
+            return pc == m_code.size() ? "match" : pc == m_code.size() + 1 ? "no match" : std::to_string(pc);
+        };
+
+        for (size_t pc = 0; pc < m_code.size(); ++pc)
+        {
+            const auto& i = m_code[pc];
+            os << pc << ": " << op_name(i.op);
+
+            if (i.op == OpCode::number_range)
+            {
+                const auto& r = m_operands.ranges[i.operand];
+                os << " [" << i.slot << "] " << (r.lo_inclusive ? "[" : "(") << r.lo << ", " << r.hi
+                   << (r.hi_inclusive ? "]" : ")");
+            }
+            else if (i.op == OpCode::number_in)
+                os << " [" << i.slot << "] " << m_operands.number_sets[i.operand]->size() << " values";
+            else if (i.op == OpCode::string_in)
+                os << " [" << i.slot << "] " << m_operands.string_sets[i.operand]->size() << " values";
+            else if (i.op >= OpCode::string_eq)
+                os << " [" << i.slot << "] \"" << m_operands.strings[i.operand] << "\"";
+            else if (i.op != OpCode::true_)
+                os << " [" << i.slot << "] " << m_operands.numbers[i.operand];
+
+            os << " ? " << target(i.on_true) << " : " << target(i.on_false) << "\n";
+        }
+
+        return os;
+    }
+}
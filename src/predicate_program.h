@@ -0,0 +1,257 @@
+#pragma once
+
+#include "predicates.h"
+#include <vector>
+
+
+namespace fastfood {
+
+    // A bound predicate tree compiled to a flat sequence of instructions.
+    // Every instruction is a test of a record; its result selects the next instruction to run, so AND and OR
+    // short-circuit by jumping over the tests that can not change the result and no virtual calls are made.
+    // A program is run until it jumps to one of two final positions: right after the code (match)
+    // or one past it (no match).
+    // Ranges and sets folded by rewrite() are single instructions rather than the comparisons they stand for.
+    // Instructions are kept small: the value an instruction compares with is in a table of its type,
+    // the instruction refers to it by the index.
+    //
+    // An instruction is tested by an inlined switch on its operation: a program runs the same instructions
+    // for every record so the branches are predicted, and the comparisons are inlined rather than called.
+    // Programs of the common shapes are matched by kernels picked by a single switch: a comparison with a number
+    // or a string equality is compared with the operator known at compile time, an AND or OR of two comparisons
+    // by a kernel instantiated for both operators, and a short AND or OR of other tests by an unrolled sequence
+    // of them with no jumps to follow. A program of any other shape is interpreted.
+    //
+    // The predicate classes remain the reference implementation.
+    class PredicateProgram
+    {
+    public:
+        enum class OpCode: uint8_t
+        {
+            true_,
+            number_eq, number_ne, number_lt, number_le, number_gt, number_ge,
+            string_eq, string_ne, string_lt, string_le, string_gt, string_ge,
+            number_range, number_in, string_in,
+        };
+
+        struct Instruction
+        {
+            uint32_t slot;
+            uint32_t on_true;   // next instruction if the test passes
+            uint32_t on_false;  // and if it fails
+            uint32_t operand;   // index in the table of the operation
+            OpCode op;
+        };
+
+        struct Range
+        {
+            double lo, hi;
+            bool lo_inclusive, hi_inclusive;
+        };
+
+        // Values the instructions compare with, strings and sets point into the predicate tree
+        struct Operands
+        {
+            std::vector<double> numbers;            // number comparisons
+            std::vector<string_view> strings;       // string comparisons
+            std::vector<Range> ranges;              // number_range
+            std::vector<const FlatHashSet<double> *> number_sets;       // number_in
+            std::vector<const FlatHashSet<string_view> *> string_sets;  // string_in
+        };
+
+        PredicateProgram() = default;
+
+        // The predicate must be bound to the schema of the records matched and must outlive the program
+        explicit PredicateProgram(const Predicate& predicate);
+
+        // Longest AND or OR matched by a kernel
+        static constexpr size_t Max_Kernel_Size = 4;
+
+        enum class Shape: uint8_t
+        {
+            generic,
+            number_eq, number_ne, number_lt, number_le, number_gt, number_ge, string_eq,
+            all_1, all_2, all_3, all_4, // AND of comparisons, a single comparison is all_1
+            any_2, any_3, any_4,        // OR of comparisons
+        };
+
+        bool match(const Record& record) const noexcept
+        {
+            switch (m_shape)
+            {
+            case Shape::number_eq: return test_number<EqualTo>(m_code[0], record);
+            case Shape::number_ne: return test_number<NotEqualTo>(m_code[0], record);
+            case Shape::number_lt: return test_number<Less>(m_code[0], record);
+            case Shape::number_le: return test_number<LessEqual>(m_code[0], record);
+            case Shape::number_gt: return test_number<Greater>(m_code[0], record);
+            case Shape::number_ge: return test_number<GreaterEqual>(m_code[0], record);
+            case Shape::string_eq: return test_string<EqualTo>(m_code[0], record);
+            case Shape::all_1: return match_all<1>(*this, record);
+            case Shape::all_2: return m_pairKernel(*this, record);
+            case Shape::all_3: return match_all<3>(*this, record);
+            case Shape::all_4: return match_all<4>(*this, record);
+            case Shape::any_2: return m_pairKernel(*this, record);
+            case Shape::any_3: return match_any<3>(*this, record);
+            case Shape::any_4: return match_any<4>(*this, record);
+            case Shape::generic: break;
+            }
+
+            return run(record);
+        }
+
+        // Runs the program instruction by instruction whatever its shape is
+        bool run(const Record& record) const noexcept
+        {
+            const auto code = m_code.data();
+            const auto size = static_cast<uint32_t>(m_code.size());
+            uint32_t pc = 0;
+
+            while (pc < size)
+            {
+                const auto& i = code[pc];
+                pc = test(i, record) ? i.on_true : i.on_false;
+            }
+
+            return pc == size;
+        }
+
+        const std::vector<Instruction>& code() const noexcept { return m_code; }
+        const Operands& operands() const noexcept { return m_operands; }
+        Shape shape() const noexcept { return m_shape; }
+
+        // True if the AND or OR of two comparisons is matched by a kernel instantiated for their operators
+        bool typed_kernel() const noexcept;
+
+        std::ostream& print(std::ostream& os) const;
+
+    private:
+        using Kernel = bool (*)(const PredicateProgram& p, const Record& record);
+
+        static Shape find_shape(const std::vector<Instruction>& code) noexcept;
+
+        // Kernel of an all_2 or any_2 program
+        static Kernel pair_kernel(bool all, OpCode first, OpCode second) noexcept;
+
+        template<bool All, OpCode First>
+        static Kernel pair_kernel(OpCode second) noexcept;
+
+        template<OpCode First, OpCode Second>
+        static bool match_all_2(const PredicateProgram& p, const Record& record) noexcept
+        {
+            return p.test<First>(p.m_code[0], record) && p.test<Second>(p.m_code[1], record);
+        }
+
+        template<OpCode First, OpCode Second>
+        static bool match_any_2(const PredicateProgram& p, const Record& record) noexcept
+        {
+            return p.test<First>(p.m_code[0], record) || p.test<Second>(p.m_code[1], record);
+        }
+
+        // The tests are unrolled, the ones past N are not evaluated
+        template<size_t N>
+        static bool match_all(const PredicateProgram& p, const Record& record) noexcept
+        {
+            static_assert(N >= 1 && N <= Max_Kernel_Size, "no kernel of the size");
+            const auto code = p.m_code.data();
+            return p.test(code[0], record) && (N < 2 || p.test(code[1], record))
+                && (N < 3 || p.test(code[2], record)) && (N < 4 || p.test(code[3], record));
+        }
+
+        template<size_t N>
+        static bool match_any(const PredicateProgram& p, const Record& record) noexcept
+        {
+            static_assert(N >= 2 && N <= Max_Kernel_Size, "no kernel of the size");
+            const auto code = p.m_code.data();
+            return p.test(code[0], record) || p.test(code[1], record)
+                || (N >= 3 && p.test(code[2], record)) || (N >= 4 && p.test(code[3], record));
+        }
+
+        bool test(const Instruction& i, const Record& record) const noexcept
+        {
+            switch (i.op)
+            {
+            case OpCode::true_: return test<OpCode::true_>(i, record);
+            case OpCode::number_eq: return test<OpCode::number_eq>(i, record);
+            case OpCode::number_ne: return test<OpCode::number_ne>(i, record);
+            case OpCode::number_lt: return test<OpCode::number_lt>(i, record);
+            case OpCode::number_le: return test<OpCode::number_le>(i, record);
+            case OpCode::number_gt: return test<OpCode::number_gt>(i, record);
+            case OpCode::number_ge: return test<OpCode::number_ge>(i, record);
+            case OpCode::string_eq: return test<OpCode::string_eq>(i, record);
+            case OpCode::string_ne: return test<OpCode::string_ne>(i, record);
+            case OpCode::string_lt: return test<OpCode::string_lt>(i, record);
+            case OpCode::string_le: return test<OpCode::string_le>(i, record);
+            case OpCode::string_gt: return test<OpCode::string_gt>(i, record);
+            case OpCode::string_ge: return test<OpCode::string_ge>(i, record);
+            case OpCode::number_range: return test<OpCode::number_range>(i, record);
+            case OpCode::number_in: return test<OpCode::number_in>(i, record);
+            case OpCode::string_in: return test<OpCode::string_in>(i, record);
+            }
+            return true;
+        }
+
+        // The switch is resolved at compile time
+        template<OpCode Op>
+        bool test(const Instruction& i, const Record& record) const noexcept
+        {
+            switch (Op)
+            {
+            case OpCode::true_: return true;
+            case OpCode::number_eq: return test_number<EqualTo>(i, record);
+            case OpCode::number_ne: return test_number<NotEqualTo>(i, record);
+            case OpCode::number_lt: return test_number<Less>(i, record);
+            case OpCode::number_le: return test_number<LessEqual>(i, record);
+            case OpCode::number_gt: return test_number<Greater>(i, record);
+            case OpCode::number_ge: return test_number<GreaterEqual>(i, record);
+            case OpCode::string_eq: return test_string<EqualTo>(i, record);
+            case OpCode::string_ne: return test_string<NotEqualTo>(i, record);
+            case OpCode::string_lt: return test_string<Less>(i, record);
+            case OpCode::string_le: return test_string<LessEqual>(i, record);
+            case OpCode::string_gt: return test_string<Greater>(i, record);
+            case OpCode::string_ge: return test_string<GreaterEqual>(i, record);
+            case OpCode::number_range: return test_number_range(i, record);
+            case OpCode::number_in: return test_number_in(i, record);
+            case OpCode::string_in: return test_string_in(i, record);
+            }
+            return true;
+        }
+
+        template<class Comp>
+        bool test_number(const Instruction& i, const Record& record) const noexcept
+        {
+            return compare_field(record.number_at(i.slot), m_operands.numbers[i.operand], Comp());
+        }
+
+        template<class Comp>
+        bool test_string(const Instruction& i, const Record& record) const noexcept
+        {
+            return compare_field(record.at(i.slot), m_operands.strings[i.operand], Comp());
+        }
+
+        bool test_number_range(const Instruction& i, const Record& record) const noexcept
+        {
+            const auto& r = m_operands.ranges[i.operand];
+            double v;
+            return field_number(record.number_at(i.slot), v)
+                && (r.lo_inclusive ? v >= r.lo : v > r.lo)
+                && (r.hi_inclusive ? v <= r.hi : v < r.hi);
+        }
+
+        bool test_number_in(const Instruction& i, const Record& record) const noexcept
+        {
+            double v;
+            return field_number(record.number_at(i.slot), v) && m_operands.number_sets[i.operand]->count(v);
+        }
+
+        bool test_string_in(const Instruction& i, const Record& record) const noexcept
+        {
+            const auto& f = record.at(i.slot);
+            return f.type() == Field::Type::string && m_operands.string_sets[i.operand]->count(f.as_string());
+        }
+
+        std::vector<Instruction> m_code;
+        Operands m_operands;
+        Shape m_shape = Shape::generic;
+        Kernel m_pairKernel = nullptr;  // all_2 and any_2
+    };
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include "types.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <iostream>
 
 
@@ -13,8 +16,30 @@ namespace fastfood
     struct compatible_field_type<std::string> { using type = string_view; };
 
 
+    enum class CompOp: uint8_t { eq, ne, lt, le, gt, ge };
+
+    // Structure of a predicate tree for the code that translates it to something else
+    class PredicateVisitor
+    {
+    public:
+        virtual ~PredicateVisitor() = default;
+
+        virtual void visit_true() = 0;
+        virtual void visit_comparison(Name field, size_t slot, CompOp op, double val) = 0;
+        virtual void visit_comparison(Name field, size_t slot, CompOp op, string_view val) = 0;
+        // lo < field < hi, each bound is either inclusive or not
+        virtual void visit_range(Name field, size_t slot, double lo, bool lo_inclusive, double hi, bool hi_inclusive) = 0;
+        // field == one of the values. The set belongs to the predicate.
+        virtual void visit_set(Name field, size_t slot, const FlatHashSet<double>& values) = 0;
+        virtual void visit_set(Name field, size_t slot, const FlatHashSet<string_view>& values) = 0;
+        virtual void visit_or(const std::vector<PredicatePtr>& predicates) = 0;
+        virtual void visit_and(const std::vector<PredicatePtr>& predicates) = 0;
+    };
+
     struct EqualTo
     {
+        static constexpr CompOp op = CompOp::eq;
+
         template<class T1, class T2>
         bool operator() (const T1& l, const T2& r) const noexcept { return l == r; }
 
@@ -23,6 +48,8 @@ namespace fastfood
 
     struct NotEqualTo
     {
+        static constexpr CompOp op = CompOp::ne;
+
         template<class T1, class T2>
         bool operator() (const T1& l, const T2& r) const noexcept { return l != r; }
 
@@ -31,6 +58,8 @@ namespace fastfood
 
     struct Less
     {
+        static constexpr CompOp op = CompOp::lt;
+
         template<class T1, class T2>
         bool operator() (const T1& l, const T2& r) const noexcept { return l < r; }
 
@@ -39,6 +68,8 @@ namespace fastfood
 
     struct LessEqual
     {
+        static constexpr CompOp op = CompOp::le;
+
         template<class T1, class T2>
         bool operator() (const T1& l, const T2& r) const noexcept { return l <= r; }
 
@@ -47,6 +78,8 @@ namespace fastfood
 
     struct Greater
     {
+        static constexpr CompOp op = CompOp::gt;
+
         template<class T1, class T2>
         bool operator() (const T1& l, const T2& r) const noexcept { return l > r; }
 
@@ -55,6 +88,8 @@ namespace fastfood
 
     struct GreaterEqual
     {
+        static constexpr CompOp op = CompOp::ge;
+
         template<class T1, class T2>
         bool operator() (const T1& l, const T2& r) const noexcept { return l >= r; }
 
@@ -86,6 +121,29 @@ namespace fastfood
         return os << val;
     }
 
+    // Compares a field with a value of a query. A field of a type that can not be compared with the value never matches.
+    template<class Comp>
+    inline bool compare_field(const Field& field, double val, const Comp& comp) noexcept
+    {
+        switch (field.type())
+        {
+        case Field::Type::double_: return comp(field.as_double(), val);
+        case Field::Type::int64: return comp(static_cast<double>(field.as_int64()), val);
+        case Field::Type::uint64: return comp(static_cast<double>(field.as_uint64()), val);
+        default: return false;
+        }
+    }
+
+    template<class Comp>
+    inline bool compare_field(const Field& field, string_view val, const Comp& comp) noexcept
+    {
+        return field.type() == Field::Type::string && comp(field.as_string(), val);
+    }
+
+    // Value of the field as a query value of the type needs it: a string field compared with a number is converted
+    inline const Field& field_value(const Record& record, size_t slot, double) noexcept { return record.number_at(slot); }
+    inline const Field& field_value(const Record& record, size_t slot, string_view) noexcept { return record.at(slot); }
+
     template<class Comp, class T, class FieldType = typename compatible_field_type<T>::type>
     class BinaryFieldPredicate final: public Predicate
     {
@@ -99,11 +157,18 @@ namespace fastfood
 
         bool match(const Record& record) const override
         {
-            const auto field = record.get(m_field);
+            const auto slot = &record.schema() == m_schema ? m_slot : record.schema().slot(m_field);
+            const FieldType val(m_val);
 
-            auto field_val = boost::get<FieldType>(&field);
+            return compare_field(field_value(record, slot, val), val, m_comp);
+        }
 
-            return !field_val ? false : m_comp(*field_val, m_val);
+        boost::tribool try_match(const Record& record) const override
+        {
+            if (!record.has_slot(&record.schema() == m_schema ? m_slot : record.schema().slot(m_field)))
+                return boost::indeterminate;
+
+            return match(record);
         }
 
         std::ostream& print(std::ostream& os) const override
@@ -114,8 +179,25 @@ namespace fastfood
 
         void visit_fields(const std::function<void(Name)>& visitor) const override { visitor(m_field); }
 
+        void bind(const RecordSchema& schema) override
+        {
+            m_schema = &schema;
+            m_slot = schema.slot(m_field);
+        }
+
+        void accept(PredicateVisitor& visitor) const override
+        {
+            visitor.visit_comparison(m_field, m_slot, Comp::op, FieldType(m_val));
+        }
+
+        PredicatePtr clone() const override { return std::make_shared<BinaryFieldPredicate>(*this); }
+
+        void print_stats(std::ostream&, unsigned) const override {}
+
     private:
         Name m_field;
+        const RecordSchema *m_schema = nullptr;
+        size_t m_slot = RecordSchema::npos;
         T m_val;     // use boost::compressed_pair
         Comp m_comp; //
     };
@@ -125,35 +207,320 @@ namespace fastfood
     public:
         bool match(const Record& record) const override { return true; }
 
+        boost::tribool try_match(const Record& record) const override { return true; }
+
         std::ostream& print(std::ostream& os) const override
         {
             return os << "<nop>";
         }
 
         void visit_fields(const std::function<void(Name)>&) const override {}
+
+        void bind(const RecordSchema&) override {}
+
+        void accept(PredicateVisitor& visitor) const override { visitor.visit_true(); }
+
+        PredicatePtr clone() const override { return std::make_shared<DummyPredicate>(); }
+
+        void print_stats(std::ostream&, unsigned) const override {}
+    };
+
+    // Never matches: what a contradiction folds to
+    class FalsePredicate final: public Predicate
+    {
+    public:
+        bool match(const Record&) const override { return false; }
+
+        boost::tribool try_match(const Record&) const override { return false; }
+
+        std::ostream& print(std::ostream& os) const override
+        {
+            return os << "<false>";
+        }
+
+        void visit_fields(const std::function<void(Name)>&) const override {}
+
+        void bind(const RecordSchema&) override {}
+
+        // An empty OR
+        void accept(PredicateVisitor& visitor) const override { visitor.visit_or({}); }
+
+        PredicatePtr clone() const override { return std::make_shared<FalsePredicate>(); }
+
+        void print_stats(std::ostream&, unsigned) const override {}
+    };
+
+    // Value of a number field as double. Returns false if the field is not a number.
+    inline bool field_number(const Field& field, double& res) noexcept
+    {
+        switch (field.type())
+        {
+        case Field::Type::double_: res = field.as_double(); return true;
+        case Field::Type::int64: res = static_cast<double>(field.as_int64()); return true;
+        case Field::Type::uint64: res = static_cast<double>(field.as_uint64()); return true;
+        default: return false;
+        }
+    }
+
+    // A predicate of a single field
+    class SingleFieldPredicateMixin
+    {
+    protected:
+        explicit SingleFieldPredicateMixin(const std::string& field): m_field(field) {}
+
+        size_t slot(const Record& record) const noexcept
+        {
+            return &record.schema() == m_schema ? m_slot : record.schema().slot(m_field);
+        }
+
+        void bind(const RecordSchema& schema)
+        {
+            m_schema = &schema;
+            m_slot = schema.slot(m_field);
+        }
+
+        Name m_field;
+        const RecordSchema *m_schema = nullptr;
+        size_t m_slot = RecordSchema::npos;
+    };
+
+    // lo < field < hi, each bound is either inclusive or not
+    class NumberRangePredicate final: public Predicate, public SingleFieldPredicateMixin
+    {
+    public:
+        NumberRangePredicate(const std::string& field, double lo, bool lo_inclusive, double hi, bool hi_inclusive)
+        : SingleFieldPredicateMixin(field)
+        , m_lo(lo)
+        , m_hi(hi)
+        , m_loInclusive(lo_inclusive)
+        , m_hiInclusive(hi_inclusive)
+        {}
+
+        bool match(const Record& record) const override
+        {
+            double v;
+            return field_number(record.number_at(slot(record)), v)
+                && (m_loInclusive ? v >= m_lo : v > m_lo)
+                && (m_hiInclusive ? v <= m_hi : v < m_hi);
+        }
+
+        boost::tribool try_match(const Record& record) const override
+        {
+            if (!record.has_slot(slot(record)))
+                return boost::indeterminate;
+
+            return match(record);
+        }
+
+        std::ostream& print(std::ostream& os) const override
+        {
+            return os << m_lo << (m_loInclusive ? " <= " : " < ") << m_field
+                      << (m_hiInclusive ? " <= " : " < ") << m_hi;
+        }
+
+        void visit_fields(const std::function<void(Name)>& visitor) const override { visitor(m_field); }
+
+        void bind(const RecordSchema& schema) override { SingleFieldPredicateMixin::bind(schema); }
+
+        void accept(PredicateVisitor& visitor) const override
+        {
+            visitor.visit_range(m_field, m_slot, m_lo, m_loInclusive, m_hi, m_hiInclusive);
+        }
+
+        PredicatePtr clone() const override { return std::make_shared<NumberRangePredicate>(*this); }
+
+        void print_stats(std::ostream&, unsigned) const override {}
+
+    private:
+        double m_lo, m_hi;
+        bool m_loInclusive, m_hiInclusive;
+    };
+
+    // field == one of the values. T is double or std::string.
+    template<class T>
+    class FieldSetPredicate final: public Predicate, public SingleFieldPredicateMixin
+    {
+    public:
+        using FieldType = typename compatible_field_type<T>::type;
+
+        FieldSetPredicate(const std::string& field, std::vector<T> values)
+        : SingleFieldPredicateMixin(field)
+        , m_values(std::make_shared<Values>(std::move(values)))
+        {}
+
+        bool match(const Record& record) const override
+        {
+            FieldType v;
+            return value(record, slot(record), v) && m_values->set.count(v);
+        }
+
+        boost::tribool try_match(const Record& record) const override
+        {
+            if (!record.has_slot(slot(record)))
+                return boost::indeterminate;
+
+            return match(record);
+        }
+
+        std::ostream& print(std::ostream& os) const override
+        {
+            os << m_field << " in (";
+
+            const char *sep = "";
+            for (auto& v: m_values->list)
+            {
+                os << sep;
+                fastfood::print(os, v);
+                sep = ", ";
+            }
+
+            return os << ")";
+        }
+
+        void visit_fields(const std::function<void(Name)>& visitor) const override { visitor(m_field); }
+
+        void bind(const RecordSchema& schema) override { SingleFieldPredicateMixin::bind(schema); }
+
+        void accept(PredicateVisitor& visitor) const override { visitor.visit_set(m_field, m_slot, m_values->set); }
+
+        PredicatePtr clone() const override { return std::make_shared<FieldSetPredicate>(*this); }
+
+        void print_stats(std::ostream&, unsigned) const override {}
+
+    private:
+        // Immutable so copies share it. The set refers to the list.
+        struct Values
+        {
+            explicit Values(std::vector<T> values): list(std::move(values)), set(list.begin(), list.end()) {}
+
+            const std::vector<T> list;
+            const FlatHashSet<FieldType> set;
+        };
+
+        static bool value(const Record& record, size_t slot, double& res) noexcept
+        {
+            return field_number(record.number_at(slot), res);
+        }
+
+        static bool value(const Record& record, size_t slot, string_view& res) noexcept
+        {
+            const auto& f = record.at(slot);
+            if (f.type() != Field::Type::string)
+                return false;
+
+            res = f.as_string();
+            return true;
+        }
+
+        std::shared_ptr<const Values> m_values;
     };
 
+    // Children of a composite predicate and the order they are evaluated in.
+    // The order adapts to the data: match_sample() is meant for samples of complete records (see AdaptiveFilter),
+    // it times the children and counts how often each one decides the result (false for AND, true for OR).
+    // match() and try_match() only follow the order so they stay const and cheap.
+    // Every Reorder_Interval samples the children are sorted by the expected cost of a decision
+    // i.e. by their average cost divided by the rate they decide at, so AND tries cheap, rarely passing children
+    // first and OR cheap, usually passing ones. accept() visits the children in that order.
     class CompositePredicateMixin
     {
     public:
+        static constexpr unsigned Reorder_Interval = 64;
+
         CompositePredicateMixin() = default;
 
-        CompositePredicateMixin(std::initializer_list<PredicatePtr> predicates): m_predicates(predicates) {}
+        CompositePredicateMixin(std::initializer_list<PredicatePtr> predicates): m_predicates(predicates)
+        {
+            reset_order();
+        }
 
         template<class InputIt>
-        CompositePredicateMixin(InputIt first, InputIt last): m_predicates(first, last) {}
+        CompositePredicateMixin(InputIt first, InputIt last): m_predicates(first, last)
+        {
+            reset_order();
+        }
 
-        void push_back(PredicatePtr pred) { m_predicates.push_back(std::move(pred)); }
+        void push_back(PredicatePtr pred)
+        {
+            m_predicates.push_back(std::move(pred));
+            reset_order();
+        }
 
     protected:
+        // In the order written in the query
         const std::vector<PredicatePtr>& predicates() const { return m_predicates; }
 
+        // In the evaluation order
+        const std::vector<PredicatePtr>& ordered_predicates() const { return m_ordered; }
+
+        // Calls `decides` for the children in the evaluation order until it returns true. Returns true if it did.
+        template<class F>
+        bool find_deciding(F&& decides) const
+        {
+            for (auto& p: m_ordered)
+                if (decides(*p))
+                    return true;
+
+            return false;
+        }
+
+        // Same but times the calls and counts the decisions. Every call must be able to decide.
+        template<class F>
+        bool find_deciding_sampled(F&& decides)
+        {
+            bool found = false;
+
+            for (auto i: m_order)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                found = decides(*m_predicates[i]);
+                const auto elapsed = std::chrono::steady_clock::now() - start;
+
+                const auto nanos = std::chrono::duration<double, std::nano>(elapsed).count();
+
+                auto& s = m_stats[i];
+                s.evaluated += 1;
+                s.decided += found;
+                s.nanos += nanos;
+                s.total.evaluated += 1;
+                s.total.decided += found;
+                s.total.nanos += nanos;
+
+                if (found)
+                    break;
+            }
+
+            if (++m_samples == Reorder_Interval)
+                reorder();
+
+            return found;
+        }
+
         void visit_fields(const std::function<void(Name)>& visitor) const
         {
             for (auto& p: m_predicates)
                 p->visit_fields(visitor);
         }
 
+        void bind(const RecordSchema& schema)
+        {
+            for (auto& p: m_predicates)
+                p->bind(schema);
+        }
+
+        // Copies the children along with their order and stats
+        void clone_from(const CompositePredicateMixin& other)
+        {
+            m_predicates.clear();
+            for (auto& p: other.m_predicates)
+                m_predicates.push_back(p->clone());
+
+            m_order = other.m_order;
+            m_stats = other.m_stats;
+            m_samples = other.m_samples;
+            update_ordered();
+        }
+
         std::ostream& print(std::ostream& os, string_view op) const
         {
             if (m_predicates.empty())
@@ -175,8 +542,97 @@ namespace fastfood
             return os;
         }
 
+        void print_stats(std::ostream& os, unsigned indent, string_view op, string_view decision) const
+        {
+            if (m_predicates.empty())
+                return;
+
+            os << std::string(indent, ' ') << op << " in evaluation order:\n";
+
+            for (auto i: m_order)
+            {
+                const auto& t = m_stats[i].total;
+
+                os << std::string(indent + 2, ' ');
+                m_predicates[i]->print(os);
+                os << ": " << decision << " ";
+
+                if (t.evaluated)
+                    os << std::lround(100.0 * t.decided / t.evaluated) << "% of " << t.evaluated
+                       << " samples, " << std::lround(t.nanos / t.evaluated) << " ns\n";
+                else
+                    os << "unknown, not sampled\n";
+
+                m_predicates[i]->print_stats(os, indent + 4);
+            }
+        }
+
     private:
+        // The weights the order is chosen by decay at every reorder, the totals are kept for print_stats()
+        struct ChildStats
+        {
+            double evaluated = 0;
+            double decided = 0;
+            double nanos = 0;
+
+            struct
+            {
+                uint64_t evaluated = 0;
+                uint64_t decided = 0;
+                double nanos = 0;
+            } total;
+        };
+
+        void reset_order()
+        {
+            m_order.resize(m_predicates.size());
+            for (size_t i = 0; i < m_order.size(); ++i)
+                m_order[i] = i;
+
+            m_stats.assign(m_predicates.size(), ChildStats());
+            m_samples = 0;
+            update_ordered();
+        }
+
+        void update_ordered()
+        {
+            m_ordered.clear();
+            for (auto i: m_order)
+                m_ordered.push_back(m_predicates[i]);
+        }
+
+        void reorder()
+        {
+            // A child that was never evaluated goes first to get measured.
+            // The decision rate is smoothed so a child that never decided still has a finite cost.
+            std::vector<double> cost(m_stats.size());
+            for (size_t i = 0; i < m_stats.size(); ++i)
+            {
+                const auto& s = m_stats[i];
+                cost[i] = s.evaluated ? (s.nanos / s.evaluated) / ((s.decided + 1) / (s.evaluated + 2)) : 0;
+            }
+
+            std::stable_sort(m_order.begin(), m_order.end(), [&](size_t l, size_t r) { return cost[l] < cost[r]; });
+            update_ordered();
+
+            // Older samples weigh less so the order follows changes in the data
+            for (auto& s: m_stats)
+            {
+                s.evaluated /= 2;
+                s.decided /= 2;
+                s.nanos /= 2;
+            }
+
+            m_samples = 0;
+        }
+
         std::vector<PredicatePtr> m_predicates;
+
+        // Adaptive evaluation order
+        std::vector<size_t> m_order;            // indexes of m_predicates
+        std::vector<PredicatePtr> m_ordered;    // m_predicates in m_order
+        std::vector<ChildStats> m_stats;        // by index of m_predicates
+        unsigned m_samples = 0;
     };
 
     // OR
@@ -190,11 +646,27 @@ namespace fastfood
 
         bool match(const Record& record) const override
         {
-            for (auto& p: predicates())
-                if (p->match(record))
-                    return true;
+            return find_deciding([&](const Predicate& p) { return p.match(record); });
+        }
 
-            return false;
+        bool match_sample(const Record& record) override
+        {
+            return find_deciding_sampled([&](Predicate& p) { return p.match_sample(record); });
+        }
+
+        boost::tribool try_match(const Record& record) const override
+        {
+            boost::tribool res = false;
+
+            const auto decided = find_deciding([&](const Predicate& p)
+            {
+                auto r = p.try_match(record);
+                if (boost::indeterminate(r))
+                    res = boost::indeterminate;
+                return bool(r);
+            });
+
+            return decided ? boost::tribool(true) : res;
         }
 
         std::ostream& print(std::ostream& os) const override
@@ -206,6 +678,25 @@ namespace fastfood
         {
             return CompositePredicateMixin::visit_fields(visitor);
         }
+
+        void bind(const RecordSchema& schema) override
+        {
+            CompositePredicateMixin::bind(schema);
+        }
+
+        void accept(PredicateVisitor& visitor) const override { visitor.visit_or(ordered_predicates()); }
+
+        PredicatePtr clone() const override
+        {
+            auto res = std::make_shared<PredicateDisjunction>();
+            res->clone_from(*this);
+            return res;
+        }
+
+        void print_stats(std::ostream& os, unsigned indent) const override
+        {
+            CompositePredicateMixin::print_stats(os, indent, "||", "passes");
+        }
     };
 
     // AND
@@ -219,13 +710,29 @@ namespace fastfood
 
         bool match(const Record& record) const override
         {
-            for (auto& p: predicates())
-                if (!p->match(record))
-                    return false;
-            
-            return true;
+            return !find_deciding([&](const Predicate& p) { return !p.match(record); });
+        }
+
+        bool match_sample(const Record& record) override
+        {
+            return !find_deciding_sampled([&](Predicate& p) { return !p.match_sample(record); });
+        }
+
+        boost::tribool try_match(const Record& record) const override
+        {
+            boost::tribool res = true;
+
+            const auto decided = find_deciding([&](const Predicate& p)
+            {
+                auto r = p.try_match(record);
+                if (boost::indeterminate(r))
+                    res = boost::indeterminate;
+                return bool(!r);
+            });
+
+            return decided ? boost::tribool(false) : res;
         }
-        
+
         std::ostream& print(std::ostream& os) const override
         {
             return CompositePredicateMixin::print(os, "&&");
@@ -235,5 +742,24 @@ namespace fastfood
         {
             return CompositePredicateMixin::visit_fields(visitor);
         }
+
+        void bind(const RecordSchema& schema) override
+        {
+            CompositePredicateMixin::bind(schema);
+        }
+
+        void accept(PredicateVisitor& visitor) const override { visitor.visit_and(ordered_predicates()); }
+
+        PredicatePtr clone() const override
+        {
+            auto res = std::make_shared<PredicateConjunction>();
+            res->clone_from(*this);
+            return res;
+        }
+
+        void print_stats(std::ostream& os, unsigned indent) const override
+        {
+            CompositePredicateMixin::print_stats(os, indent, "&&", "fails");
+        }
     };
 }
\ No newline at end of file
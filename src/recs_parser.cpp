@@ -1,251 +1,292 @@
 #include "recs_parser.h"
-
-#include <boost/spirit/include/qi.hpp>
-#include <boost/spirit/include/qi_grammar.hpp>
-#include <boost/spirit/include/qi_parse.hpp>
-#include <boost/spirit/include/qi_int.hpp>
-#include <boost/spirit/include/qi_real.hpp>
-#include <boost/spirit/include/phoenix_core.hpp>
-#include <boost/spirit/include/phoenix_operator.hpp>
-#include <tuple>
+#include <algorithm>
+#include <atomic>
 
 
 namespace fastfood {
-    namespace {
-        namespace qi = boost::spirit::qi;
-        namespace ns = boost::spirit::standard;
-
-        using ns::no_case;
-        using boost::spirit::lit;
-        using boost::spirit::long_;
-        using boost::spirit::double_;
-        using boost::spirit::qi::_1;
+    inline void RecsParser::parse_timing(string_view timings)
+    {
+        const auto& timers = m_interestingSubFields.timers();
 
-        using component_time = std::tuple<long, long>;
+        if (timers.empty())
+            return;
 
-        template <typename Iterator, typename Skipper = qi::space_type>
-        struct ComponentTimeGramar: qi::grammar<Iterator, component_time(), Skipper>
+        while (!timings.empty())
         {
-            ComponentTimeGramar() : ComponentTimeGramar::base_type(t, "component_time")
-            {
-                t %= no_case[long_ > "msecs" > long_ > "usecs"];
-            }
+            auto pos = timings.find(':');
 
-            using It = Iterator;
-            using Sk = Skipper;
+            if (pos == string_view::npos)
+                throw std::runtime_error("Can not parse recs stream: invalid 'Timing' field: " + timings.to_string());
 
-            qi::rule<It, component_time(), Sk> t;
-        };
+            const auto fields = timers.find(timings.substr(0, pos));
 
-        const ComponentTimeGramar<string_view::const_iterator> s_component_time_parser;
+            timings.remove_prefix(pos + 1);
 
-        inline Field convert_time(string_view time_str)
-        {
-            component_time t;
+            pos = timings.find(',');
 
-            if (!qi::phrase_parse(time_str.begin(), time_str.end(), s_component_time_parser[boost::phoenix::ref(t) = _1], ns::space))
-                return time_str;
-            else
-                return double(std::get<0>(t)) + double(std::get<1>(t)) / 1000.0;
-        }
+            if (fields)
+            {
+                const auto entry = timings.substr(0, pos);
+                const auto slash = entry.find('/');
 
-        inline double convert_double(string_view s)
-        {
-            double res;
+                if (slash == string_view::npos)
+                    throw std::runtime_error("Can not parse recs stream: invalid 'Timing' field: " + timings.to_string());
 
-            if (!qi::phrase_parse(s.begin(), s.end(), double_[boost::phoenix::ref(res) = _1], ns::space))
-                throw std::runtime_error("Can not parse recs stream: invalid floating point number: " + s.to_string());
-            return res;
-        }
+                if (fields->time)
+                    set_value(*fields->time, entry.substr(0, slash));
 
-        inline long convert_long(string_view s)
-        {
-            long res;
+                if (fields->count)
+                    set_value(*fields->count, entry.substr(slash + 1));
+            }
 
-            if (!qi::phrase_parse(s.begin(), s.end(), long_[boost::phoenix::ref(res) = _1], ns::space))
-                throw std::runtime_error("Can not parse recs stream: invalid long number: " + s.to_string());
-            return res;
+            if (pos == string_view::npos)
+                return;
+
+            timings.remove_prefix(pos + 1);
         }
     }
 
-    inline size_t RecsParser::parse_timing(string_view timings)
+    inline void RecsParser::parse_counters(string_view counters)
     {
-        size_t added = 0;
+        const auto& interesting = m_interestingSubFields.counters();
 
-        while (!timings.empty())
+        if (interesting.empty())
+            return;
+
+        while (!counters.empty())
         {
-            auto pos = timings.find(':');
+            auto pos = counters.find('=');
 
             if (pos == string_view::npos)
-                throw std::runtime_error("Can not parse recs stream: invalid 'Timing' field: " + timings.to_string());
+                throw std::runtime_error("Can not parse recs stream: invalid 'Counters' field: " + counters.to_string());
 
-            m_name1 = "timer-";
-            m_name1.append(timings.data(), pos);
-            m_name1.append("-time");
+            const auto fields = interesting.find(counters.substr(0, pos));
 
-            m_name2 = "timer-";
-            m_name2.append(timings.data(), pos);
-            m_name2.append("-count");
+            counters.remove_prefix(pos + 1);
+            pos = counters.find(',');
 
-            timings.remove_prefix(pos + 1);
+            if (fields && fields->value)
+                set_value(*fields->value, counters.substr(0, pos));
 
-            pos = timings.find('/');
             if (pos == string_view::npos)
-                throw std::runtime_error("Can not parse recs stream: invalid 'Timing' field: " + timings.to_string());
+                return;
 
-            auto time_value = timings.substr(0, pos);
+            counters.remove_prefix(pos + 1);
+        }
+    }
 
-            timings.remove_prefix(pos + 1);
+    constexpr size_t RecsParser::Stream_Block_Size;
 
-            pos = timings.find(',');
+    void RecsParser::invalid_value(size_t slot, string_view raw)
+    {
+        static std::atomic<bool> reported{false};
 
-            auto count_value = timings.substr(0, pos);
+        if (m_invalidValues++ == 0 && !reported.exchange(true))
+        {
+            std::cerr << "Warning: invalid value of field '" << m_current.schema().name(slot) << "': " << raw
+                      << ", taken as NULL. Other invalid values are not reported.\n";
+        }
+    }
 
-            Name name1{m_name1};
+    RecsParser::RecsParser(std::istream& is, const RecordSchema& schema, const Predicate *filter, size_t block_size)
+    : m_stream(&is)
+    , m_interestingFields(schema)
+    , m_interestingSubFields(schema)
+    , m_filter(filter)
+    , m_filterSlots(schema.size())
+    , m_current(schema)
+    , m_buffer(std::max<size_t>(block_size, 1))
+    , m_scanner(m_buffer.data(), m_buffer.data())
+    {
+        m_stream->exceptions(std::ios_base::badbit);
+        init_filter(schema);
+    }
 
-            if (is_interesting_field(name1))
-            {
-                m_current.set(name1, convert_double(time_value));
-                ++added;
-            }
+    RecsParser::RecsParser(string_view buffer, const RecordSchema& schema, const Predicate *filter)
+    : m_stream(nullptr)
+    , m_interestingFields(schema)
+    , m_interestingSubFields(schema)
+    , m_filter(filter)
+    , m_filterSlots(schema.size())
+    , m_current(schema)
+    , m_scanner(buffer.data(), buffer.data() + buffer.size())
+    {
+        init_filter(schema);
+    }
 
-            Name name2{m_name2};
+    void RecsParser::init_filter(const RecordSchema& schema)
+    {
+        if (!m_filter)
+            return;
 
-            if (is_interesting_field(name2))
-            {
-                m_current.set(name2, convert_long(count_value));
-                ++added;
-            }
+        m_filter->visit_fields([&](Name f)
+        {
+            const auto slot = schema.slot(f);
+            if (slot == RecordSchema::npos)
+                return;
 
-            if (pos == string_view::npos)
-                return added;
+            m_filterSlots[slot] = true;
 
-            timings.remove_prefix(pos + 1);
-        }
+            // Timing and Counters lines set timer-* and counter-* fields too
+            const auto name = f.str();
+            const std::string line = name.starts_with("timer-") ? "\nTiming="
+                : name.starts_with("counter-") ? "\nCounters=" : "";
 
-        return added;
+            for (auto l: {"\n" + name.to_string() + "=", line})
+            {
+                if (!l.empty() && std::find(m_filterLines.begin(), m_filterLines.end(), l) == m_filterLines.end())
+                    m_filterLines.push_back(l);
+            }
+        });
     }
 
-    inline size_t RecsParser::parse_counters(string_view counters)
+    bool RecsParser::refill()
     {
-        size_t added = 0;
+        if (!m_stream || m_stream->eof())
+            return false;
 
-        while (!counters.empty())
-        {
-            auto pos = counters.find('=');
+        // Values of the record are in the arena so only a partial line has to be kept, and the whole record
+        // if there's a filter as a skipped record may have to be parsed again (see skip_record())
+        const auto keep_from = m_filter ? m_recordStart : m_scanner.position();
+        const auto kept = static_cast<size_t>(m_scanner.end() - keep_from);
+        const auto position = static_cast<size_t>(m_scanner.position() - keep_from);
 
-            if (pos == string_view::npos)
-                throw std::runtime_error("Can not parse recs stream: invalid 'Counters' field: " + counters.to_string());
+        std::memmove(m_buffer.data(), keep_from, kept);
 
-            m_name1 = "counter-";
-            m_name1.append(counters.data(), pos);
-            m_name1.append("-value");
+        if (kept == m_buffer.size())
+            m_buffer.resize(m_buffer.size() * 2);
 
-            counters.remove_prefix(pos + 1);
-            pos = counters.find(',');
+        const auto data = m_buffer.data();
 
-            auto value = counters.substr(0, pos);
+        m_stream->read(data + kept, m_buffer.size() - kept);
+        const auto read = static_cast<size_t>(m_stream->gcount());
 
-            Name name1{m_name1};
+        m_recordStart = data;
+        m_scanner.reset(data + position, data + kept + read);
+        return read != 0;
+    }
+
+    bool RecsParser::skip_record()
+    {
+        // Offsets from the record start as refills move the record in the buffer
+        const auto skipped = static_cast<size_t>(m_scanner.position() - m_recordStart);
+        auto from = skipped;
+        bool line_start = true;
 
-            if (is_interesting_field(name1))
+        for (;;)
+        {
+            const auto end = m_scanner.end();
+
+            if (auto record_end = find_record_end(m_recordStart + from, end, line_start))
             {
-                m_current.set(name1, convert_double(value));
-                ++added;
+                // Starts with the '\n' of the line the filter failed on
+                const auto rest_start = m_recordStart + skipped - 1;
+                const string_view rest{rest_start, static_cast<size_t>(record_end - rest_start)};
+
+                m_scanner.reset(record_end, end);
+                return !sets_filter_field(rest);
             }
 
-            if (pos == string_view::npos)
-                return added;
+            // Nothing is found before a possible beginning of "\nEOE\n" at the end
+            const auto size = static_cast<size_t>(end - m_recordStart);
+            if (size > from + 4)
+            {
+                from = size - 4;
+                line_start = false;
+            }
 
-            counters.remove_prefix(pos + 1);
+            if (!refill())
+                throw std::runtime_error("Can not parse recs stream: unexpected EOF");
         }
-
-        return added;
     }
 
-    constexpr auto Line_Buf_Size = 65535;
-    constexpr auto Lines_Buf = 1024;
-
-    RecsParser::RecsParser(std::istream& is, const FieldSet& interestingFields)
-    : m_stream(is)
-    , m_interestingFields(interestingFields)
-    , m_current(Lines_Buf)
+    bool RecsParser::sets_filter_field(string_view lines) const noexcept
     {
-        m_stream.exceptions(std::ios_base::badbit);
-
-        m_name1.reserve(256);
-        m_name2.reserve(256);
+        for (auto& l: m_filterLines)
+        {
+            if (::memmem(lines.data(), lines.size(), l.data(), l.size()))
+                return true;
+        }
 
-        m_lines.resize(Lines_Buf);
-        for (auto& i: m_lines)
-            i.reserve(Line_Buf_Size);
+        return false;
     }
 
-    bool RecsParser::next()
+    bool RecsParser::next(bool filtered)
     {
-        m_current.clear();
-        m_empty = true;
-        m_line = m_lines.begin();
-
-        skip_divider();
+        begin_record(filtered);
+        bool first_line = true;
 
         for (;;)
         {
-            size_t added = 0;
+            ScannedLine line;
 
-            std::getline(m_stream, *m_line);
+            if (!m_scanner.next(line))
+            {
+                if (!refill())
+                {
+                    if (m_empty)
+                        return false;
+                    else
+                        throw std::runtime_error("Can not parse recs stream: unexpected EOF");
+                }
+
+                continue;
+            }
 
-            if (m_stream.eof())
+            if (first_line)
             {
-                if (m_empty)
-                    return false;
-                else
-                    throw std::runtime_error("Can not parse recs stream: unexpected EOF");
+                first_line = false;
+
+                // Let's assume it's a delimiter line so ignore it.
+                // TODO: It's a bit hacky because we throw away a name=value line where name starts with '-', but let's ignore it for now.
+                if (!line.text.empty() && line.text.front() == '-')
+                    continue;
             }
 
-            if (*m_line == "EOE")
-                return true;
+            if (line.separator == LineScanner::npos)
+            {
+                if (line.text == "EOE")
+                    return true;
+
+                throw std::runtime_error("Can not parse recs stream: not a name=value line: " + line.text.to_string());
+            }
 
             m_empty = false;
 
-            auto name = extract_name();
-            auto value = string_view{*m_line}.substr(name.size() + 1);
+            auto name = line.text.substr(0, line.separator);
+            auto value = line.text.substr(line.separator + 1);
 
             if (name == "Timing")
             {
-                added = parse_timing(value);
+                parse_timing(value);
             }
             else if (name == "Counters")
             {
-                added = parse_counters(value);
+                parse_counters(value);
             }
             else
             {
-                Name f{name};
-                if (!is_interesting_field(f))
+                auto f = m_interestingFields.find(name);
+                if (!f)
                     continue;
 
-                if (name == "UserTime" || name == "SystemTime" || name == "Time")
+                set_value(*f, value);
+            }
+
+            if (!check_filter())
+            {
+                if (skip_record())
                 {
-                    m_current.set(f, convert_time(value));
-                    ++added;
+                    begin_record();
                 }
                 else
                 {
-                    m_current.set(f, value);
-                    ++added;
+                    // The last value of a field counts and the one the filter failed on is not the last
+                    m_scanner.reset(m_recordStart, m_scanner.end());
+                    begin_record(false);
                 }
-            }
-
-            if (added)
-            {
-                ++m_line;
 
-                if (m_line == m_lines.end())
-                {
-                    m_lines.push_back(std::string());
-                    m_lines.back().reserve(Line_Buf_Size);
-                }
+                first_line = true;
             }
         }
     }
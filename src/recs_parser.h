@@ -1,9 +1,12 @@
 #pragma once
 
 #include "types.h"
+#include "arena.h"
+#include "block_scanner.h"
+#include "field_matcher.h"
 #include <stdexcept>
+#include <string>
 #include <iostream>
-#include <limits>
 #include <vector>
 
 
@@ -12,61 +15,135 @@ namespace fastfood {
     class RecsParser
     {
     public:
-        RecsParser(std::istream& is, const FieldSet& interestingFields);
+        static constexpr size_t Stream_Block_Size = 64 * 1024;
+
+        // Records produced have the given schema, other fields are skipped.
+        // If `filter` is given then it's evaluated while a record is being parsed and the rest of
+        // a record that can not match is skipped. A record returned still must be matched against the filter
+        // unless matched() is true.
+        // The stream is read into a buffer of `block_size` bytes, it grows only to fit a longer line or record.
+        RecsParser(std::istream& is, const RecordSchema& schema, const Predicate *filter = nullptr,
+                   size_t block_size = Stream_Block_Size);
+
+        // Zero-copy mode: parses an in-memory buffer (e.g. a memory-mapped file).
+        // Names and values of the produced records point straight into `buffer`
+        // so it must outlive the parser and the records.
+        RecsParser(string_view buffer, const RecordSchema& schema, const Predicate *filter = nullptr);
 
         const Record& current() const { return m_current; }
 
-        bool next();
+        // Number of values of declared kinds that could not be decoded and were taken as NULL.
+        // Only the first one parsed by any parser is reported (to stderr).
+        size_t invalid_values() const noexcept { return m_invalidValues; }
+
+        // The filter is not applied to the record if `filtered` is false, the record is then parsed in full
+        bool next(bool filtered = true);
+
+        // True if the filter matched the current record while it was parsed
+        bool matched() const noexcept { return m_filterState == FilterState::matched; }
 
     private:
-        bool skip_divider()
+        // Stream mode: reads the next block from the stream keeping a partial line in the buffer.
+        // Returns false at the end of the stream and always in buffer mode.
+        bool refill();
+
+        // Stream mode: the buffer is reused while the record is parsed so values are copied into the arena
+        string_view keep(string_view value)
         {
-            auto c = m_stream.get();
+            return m_stream ? m_values.copy(value) : value;
+        }
 
-            if (c == traits::eof())
-                return false;
+        // Fields of declared kinds are decoded right away, the rest are decoded by the record when used
+        void set_value(size_t slot, string_view raw)
+        {
+            const auto& schema = m_current.schema();
 
-            if (c != '-')
+            if (!schema.declared(slot) || schema.kind(slot) == FieldKind::string)
             {
-                m_stream.unget();
-                return true;
+                set_field(slot, keep(raw));
+                return;
             }
 
-            // Let's assume it's a delimiter line so ignore it.
-            // TODO: It's a bit hacky because we throw away a name=value line where name starts with '-', but let's ignore it for now.
-            m_stream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-            return true;
+            Field value;
+            if (!decode_value(schema.kind(slot), raw, value))
+                invalid_value(slot, raw);
+
+            set_field(slot, value);
         }
 
-        bool is_interesting_field(Name name) const noexcept
+        // A value that is not of the declared kind is NULL in the record
+        void invalid_value(size_t slot, string_view raw);
+
+        template<class Value>
+        void set_field(size_t slot, Value&& value)
         {
-            return m_interestingFields.count(name) != 0;
+            m_current.set_slot(slot, std::forward<Value>(value));
+
+            // The last value of a field counts so a match found before may be gone
+            if (m_filterState != FilterState::off && m_filterSlots[slot])
+            {
+                m_filterState = FilterState::undecided;
+                m_filterChanged = true;
+            }
         }
 
-        string_view extract_name()
+        // Returns false if the current record can not match the filter unless a field of the filter is set again
+        bool check_filter()
         {
-            auto pos = m_line->find('=');
+            if (!m_filterChanged)
+                return true;
+
+            m_filterChanged = false;
+
+            const auto res = m_filter->try_match(m_current);
+            if (res)
+                m_filterState = FilterState::matched;
 
-            if (pos == std::string::npos)
-                throw std::runtime_error("Can not parse recs stream: not a name=value line: " + *m_line);
+            return static_cast<bool>(res || boost::indeterminate(res));
+        }
 
-            return {m_line->data(), pos};
+        // The filter is applied to the record only if `filtered`
+        void begin_record(bool filtered = true)
+        {
+            m_current.clear();
+            m_values.reset();
+            m_recordStart = m_scanner.position();
+            m_empty = true;
+            m_filterState = m_filter && filtered ? FilterState::undecided : FilterState::off;
+            m_filterChanged = false;
         }
 
-        size_t parse_timing(string_view timings);
-        size_t parse_counters(string_view counters);
+        void init_filter(const RecordSchema& schema);
+
+        // Skips the rest of the current record without parsing its lines. Returns false if a field
+        // of the filter is set again there, then the record has to be parsed again with no filter.
+        bool skip_record();
 
-        using traits = std::istream::traits_type;
+        // True if one of the lines sets a field the filter depends on
+        bool sets_filter_field(string_view lines) const noexcept;
 
-        std::istream& m_stream;
-        const FieldSet& m_interestingFields;
+        void parse_timing(string_view timings);
+        void parse_counters(string_view counters);
+
+        std::istream *m_stream; // null in buffer mode
+        const FieldMatcher m_interestingFields;
+        const SubFieldMatcher m_interestingSubFields;
+        const Predicate *m_filter;
+        std::vector<bool> m_filterSlots;
+        std::vector<std::string> m_filterLines; // "\n<name>=" of the lines that set fields of the filter
 
         MutableRecord m_current;
+        Arena m_values;                 // stream mode only
+
+        enum class FilterState: uint8_t { off, undecided, matched };
 
         // Parsing state and buffers
-        std::vector<std::string> m_lines;
-        std::vector<std::string>::iterator m_line;
-        std::string m_name1, m_name2;
+        std::vector<char> m_buffer;     // stream mode only, grows only to fit a longer line or, with a filter, record
+        LineScanner m_scanner;
+        const char *m_recordStart = nullptr; // in the buffer, stream mode keeps it there only if there's a filter
         bool m_empty;
+        FilterState m_filterState = FilterState::off;
+        bool m_filterChanged;
+        size_t m_invalidValues = 0;
     };
 }
\ No newline at end of file
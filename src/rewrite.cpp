@@ -0,0 +1,507 @@
+#include "rewrite.h"
+#include "predicates.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace fastfood {
+    namespace {
+        // Predicate tree in a form that is easy to take apart and put together
+        struct Term
+        {
+            enum class Kind: uint8_t { true_, false_, number, string, and_, or_, range, number_set, string_set };
+
+            Kind kind = Kind::true_;
+            std::string field;
+            CompOp op = CompOp::eq;
+            double number = 0;
+            std::string string;
+            double lo = 0, hi = 0;              // range
+            bool loInclusive = false, hiInclusive = false;
+            std::vector<double> numbers;        // number_set
+            std::vector<std::string> strings;   // string_set
+            std::vector<Term> children;         // and_, or_
+        };
+
+        Term constant(bool value)
+        {
+            Term t;
+            t.kind = value ? Term::Kind::true_ : Term::Kind::false_;
+            return t;
+        }
+
+        Term number_comparison(const std::string& field, CompOp op, double val)
+        {
+            Term t;
+            t.kind = Term::Kind::number;
+            t.field = field;
+            t.op = op;
+            t.number = val;
+            return t;
+        }
+
+        Term string_comparison(const std::string& field, CompOp op, const std::string& val)
+        {
+            Term t;
+            t.kind = Term::Kind::string;
+            t.field = field;
+            t.op = op;
+            t.string = val;
+            return t;
+        }
+
+        class Describer final: public PredicateVisitor
+        {
+        public:
+            explicit Describer(Term& term): m_term(term) {}
+
+            void visit_true() override
+            {
+                m_term = constant(true);
+            }
+
+            void visit_comparison(Name field, size_t, CompOp op, double val) override
+            {
+                m_term = number_comparison(field.str().to_string(), op, val);
+            }
+
+            void visit_comparison(Name field, size_t, CompOp op, string_view val) override
+            {
+                m_term = string_comparison(field.str().to_string(), op, val.to_string());
+            }
+
+            void visit_range(Name field, size_t, double lo, bool lo_inclusive, double hi, bool hi_inclusive) override
+            {
+                m_term.kind = Term::Kind::range;
+                m_term.field = field.str().to_string();
+                m_term.lo = lo;
+                m_term.hi = hi;
+                m_term.loInclusive = lo_inclusive;
+                m_term.hiInclusive = hi_inclusive;
+            }
+
+            // The values are sorted so the result does not depend on the order of the hash set
+            void visit_set(Name field, size_t, const FlatHashSet<double>& values) override
+            {
+                m_term.kind = Term::Kind::number_set;
+                m_term.field = field.str().to_string();
+                m_term.numbers.assign(values.begin(), values.end());
+                std::sort(m_term.numbers.begin(), m_term.numbers.end());
+            }
+
+            void visit_set(Name field, size_t, const FlatHashSet<string_view>& values) override
+            {
+                m_term.kind = Term::Kind::string_set;
+                m_term.field = field.str().to_string();
+                for (auto v: values)
+                    m_term.strings.push_back(v.to_string());
+                std::sort(m_term.strings.begin(), m_term.strings.end());
+            }
+
+            void visit_or(const std::vector<PredicatePtr>& predicates) override
+            {
+                if (predicates.empty())
+                    m_term = constant(false);
+                else
+                    composite(Term::Kind::or_, predicates);
+            }
+
+            void visit_and(const std::vector<PredicatePtr>& predicates) override
+            {
+                composite(Term::Kind::and_, predicates);
+            }
+
+        private:
+            void composite(Term::Kind kind, const std::vector<PredicatePtr>& predicates)
+            {
+                m_term.kind = kind;
+                m_term.children.resize(predicates.size());
+
+                for (size_t i = 0; i < predicates.size(); ++i)
+                {
+                    Describer d(m_term.children[i]);
+                    predicates[i]->accept(d);
+                }
+            }
+
+            Term& m_term;
+        };
+
+        // Comparisons of a field with numbers in an AND: the field can be equal to one value only
+        // and must be within the intersection of the bounds
+        struct NumberConstraints
+        {
+            bool add(CompOp op, double v)
+            {
+                switch (op)
+                {
+                case CompOp::eq:
+                    if (hasEq && eq != v)
+                        return false;
+                    hasEq = true;
+                    eq = v;
+                    break;
+                case CompOp::ne:
+                    ne.push_back(v);
+                    break;
+                case CompOp::lt:
+                    if (!hasHi || v < hi || (v == hi && hiInclusive))
+                        set_hi(v, false);
+                    break;
+                case CompOp::le:
+                    if (!hasHi || v < hi)
+                        set_hi(v, true);
+                    break;
+                case CompOp::gt:
+                    if (!hasLo || v > lo || (v == lo && loInclusive))
+                        set_lo(v, false);
+                    break;
+                case CompOp::ge:
+                    if (!hasLo || v > lo)
+                        set_lo(v, true);
+                    break;
+                }
+
+                return true;
+            }
+
+            // Returns false on contradiction
+            bool finish(const std::string& field, std::vector<Term>& res) const
+            {
+                if (!hasEq && hasLo && hasHi && lo == hi)
+                {
+                    if (!loInclusive || !hiInclusive)
+                        return false;
+
+                    return equal(field, lo, res);
+                }
+
+                if (hasEq)
+                {
+                    if ((hasLo && (eq < lo || (eq == lo && !loInclusive))) || (hasHi && (eq > hi || (eq == hi && !hiInclusive))))
+                        return false;
+
+                    return equal(field, eq, res);
+                }
+
+                if (hasLo && hasHi)
+                {
+                    if (lo > hi)
+                        return false;
+
+                    Term t;
+                    t.kind = Term::Kind::range;
+                    t.field = field;
+                    t.lo = lo;
+                    t.hi = hi;
+                    t.loInclusive = loInclusive;
+                    t.hiInclusive = hiInclusive;
+                    res.push_back(std::move(t));
+                }
+                else if (hasLo)
+                    res.push_back(number_comparison(field, loInclusive ? CompOp::ge : CompOp::gt, lo));
+                else if (hasHi)
+                    res.push_back(number_comparison(field, hiInclusive ? CompOp::le : CompOp::lt, hi));
+
+                for (auto v: ne)
+                    res.push_back(number_comparison(field, CompOp::ne, v));
+
+                return true;
+            }
+
+            bool hasEq = false, hasLo = false, hasHi = false;
+            bool loInclusive = false, hiInclusive = false;
+            double eq = 0, lo = 0, hi = 0;
+            std::vector<double> ne;
+
+        private:
+            void set_lo(double v, bool inclusive) { hasLo = true; lo = v; loInclusive = inclusive; }
+            void set_hi(double v, bool inclusive) { hasHi = true; hi = v; hiInclusive = inclusive; }
+
+            bool equal(const std::string& field, double v, std::vector<Term>& res) const
+            {
+                // The other != are implied
+                if (std::find(ne.begin(), ne.end(), v) != ne.end())
+                    return false;
+
+                res.push_back(number_comparison(field, CompOp::eq, v));
+                return true;
+            }
+        };
+
+        // Equalities and inequalities of a field with strings in an AND
+        struct StringConstraints
+        {
+            bool add(CompOp op, const std::string& v)
+            {
+                if (op == CompOp::ne)
+                {
+                    ne.push_back(v);
+                    return true;
+                }
+
+                if (hasEq && eq != v)
+                    return false;
+
+                hasEq = true;
+                eq = v;
+                return true;
+            }
+
+            bool finish(const std::string& field, std::vector<Term>& res) const
+            {
+                if (hasEq)
+                {
+                    if (std::find(ne.begin(), ne.end(), eq) != ne.end())
+                        return false;
+
+                    res.push_back(string_comparison(field, CompOp::eq, eq));
+                    return true;
+                }
+
+                for (auto& v: ne)
+                    res.push_back(string_comparison(field, CompOp::ne, v));
+
+                return true;
+            }
+
+            bool hasEq = false;
+            std::string eq;
+            std::vector<std::string> ne;
+        };
+
+        // Equalities of a field in an OR
+        template<class T>
+        struct EqualValues
+        {
+            bool add(CompOp, const T& v)
+            {
+                if (std::find(values.begin(), values.end(), v) == values.end())
+                    values.push_back(v);
+                return true;
+            }
+
+            bool finish(const std::string& field, std::vector<Term>& res) const
+            {
+                res.push_back(values.size() == 1 ? make_equal(field, values.front()) : make_set(field, values));
+                return true;
+            }
+
+            static Term make_equal(const std::string& field, double v) { return number_comparison(field, CompOp::eq, v); }
+            static Term make_equal(const std::string& field, const std::string& v) { return string_comparison(field, CompOp::eq, v); }
+
+            static Term make_set(const std::string& field, const std::vector<double>& v)
+            {
+                Term t;
+                t.kind = Term::Kind::number_set;
+                t.field = field;
+                t.numbers = v;
+                return t;
+            }
+
+            static Term make_set(const std::string& field, const std::vector<std::string>& v)
+            {
+                Term t;
+                t.kind = Term::Kind::string_set;
+                t.field = field;
+                t.strings = v;
+                return t;
+            }
+
+            std::vector<T> values;
+        };
+
+        // Merges the terms of each field that `Group` accepts into the group and replaces them with the terms
+        // the group finishes with, placed where the first of them was. Returns false on contradiction.
+        template<class Group, class Accepts, class Value>
+        bool merge(std::vector<Term>& terms, Accepts accepts, Value value)
+        {
+            std::vector<std::vector<Term>> res;   // a group leaves an empty placeholder
+            std::vector<std::pair<std::string, Group>> groups;
+            std::vector<size_t> positions;          // of the groups in res
+
+            for (auto& t: terms)
+            {
+                if (!accepts(t))
+                {
+                    res.emplace_back();
+                    res.back().push_back(std::move(t));
+                    continue;
+                }
+
+                auto it = std::find_if(groups.begin(), groups.end(), [&](const std::pair<std::string, Group>& g) { return g.first == t.field; });
+                if (it == groups.end())
+                {
+                    groups.emplace_back(t.field, Group());
+                    it = groups.end() - 1;
+                    positions.push_back(res.size());
+                    res.emplace_back();
+                }
+
+                if (!it->second.add(t.op, value(t)))
+                    return false;
+            }
+
+            for (size_t i = 0; i < groups.size(); ++i)
+                if (!groups[i].second.finish(groups[i].first, res[positions[i]]))
+                    return false;
+
+            terms.clear();
+            for (auto& r: res)
+                for (auto& t: r)
+                    terms.push_back(std::move(t));
+
+            return true;
+        }
+
+        double number_value(const Term& t) { return t.number == 0 ? 0.0 : t.number; }  // -0 is 0
+        const std::string& string_value(const Term& t) { return t.string; }
+
+        bool is_number(const Term& t) { return t.kind == Term::Kind::number && !std::isnan(t.number); }
+        bool is_string_equality(const Term& t)
+        {
+            return t.kind == Term::Kind::string && (t.op == CompOp::eq || t.op == CompOp::ne);
+        }
+
+        bool merge_and(std::vector<Term>& terms)
+        {
+            // A range merged before (in a nested AND) is merged again with the other bounds
+            std::vector<Term> expanded;
+            for (auto& t: terms)
+            {
+                if (t.kind == Term::Kind::range)
+                {
+                    expanded.push_back(number_comparison(t.field, t.loInclusive ? CompOp::ge : CompOp::gt, t.lo));
+                    expanded.push_back(number_comparison(t.field, t.hiInclusive ? CompOp::le : CompOp::lt, t.hi));
+                }
+                else
+                    expanded.push_back(std::move(t));
+            }
+            terms = std::move(expanded);
+
+            return merge<NumberConstraints>(terms, is_number, number_value)
+                && merge<StringConstraints>(terms, is_string_equality, string_value);
+        }
+
+        void merge_or(std::vector<Term>& terms)
+        {
+            // A set merged before is merged again with the other equalities
+            std::vector<Term> expanded;
+            for (auto& t: terms)
+            {
+                if (t.kind == Term::Kind::number_set)
+                {
+                    for (auto v: t.numbers)
+                        expanded.push_back(number_comparison(t.field, CompOp::eq, v));
+                }
+                else if (t.kind == Term::Kind::string_set)
+                {
+                    for (auto& v: t.strings)
+                        expanded.push_back(string_comparison(t.field, CompOp::eq, v));
+                }
+                else
+                    expanded.push_back(std::move(t));
+            }
+            terms = std::move(expanded);
+
+            merge<EqualValues<double>>(terms, [](const Term& t) { return is_number(t) && t.op == CompOp::eq; }, number_value);
+            merge<EqualValues<std::string>>(terms, [](const Term& t) { return t.kind == Term::Kind::string && t.op == CompOp::eq; }, string_value);
+        }
+
+        Term simplify(Term t)
+        {
+            if (t.kind != Term::Kind::and_ && t.kind != Term::Kind::or_)
+                return t;
+
+            const bool is_and = t.kind == Term::Kind::and_;
+            std::vector<Term> children;
+
+            for (auto& c: t.children)
+            {
+                auto s = simplify(std::move(c));
+
+                if (s.kind == t.kind)
+                    std::move(s.children.begin(), s.children.end(), std::back_inserter(children));
+                else if (s.kind == (is_and ? Term::Kind::true_ : Term::Kind::false_))
+                    continue;
+                else if (s.kind == (is_and ? Term::Kind::false_ : Term::Kind::true_))
+                    return s;
+                else
+                    children.push_back(std::move(s));
+            }
+
+            if (is_and)
+            {
+                if (!merge_and(children))
+                    return constant(false);
+            }
+            else
+                merge_or(children);
+
+            if (children.empty())
+                return constant(is_and);
+            if (children.size() == 1)
+                return std::move(children.front());
+
+            t.children = std::move(children);
+            return t;
+        }
+
+        template<class T>
+        PredicatePtr make_comparison(const std::string& field, CompOp op, const T& val)
+        {
+            switch (op)
+            {
+            case CompOp::eq: return std::make_shared<BinaryFieldPredicate<EqualTo, T>>(field, val);
+            case CompOp::ne: return std::make_shared<BinaryFieldPredicate<NotEqualTo, T>>(field, val);
+            case CompOp::lt: return std::make_shared<BinaryFieldPredicate<Less, T>>(field, val);
+            case CompOp::le: return std::make_shared<BinaryFieldPredicate<LessEqual, T>>(field, val);
+            case CompOp::gt: return std::make_shared<BinaryFieldPredicate<Greater, T>>(field, val);
+            case CompOp::ge: return std::make_shared<BinaryFieldPredicate<GreaterEqual, T>>(field, val);
+            }
+            return nullptr;
+        }
+
+        PredicatePtr build(const Term& t)
+        {
+            switch (t.kind)
+            {
+            case Term::Kind::true_: return std::make_shared<DummyPredicate>();
+            case Term::Kind::false_: return std::make_shared<FalsePredicate>();
+            case Term::Kind::number: return make_comparison(t.field, t.op, t.number);
+            case Term::Kind::string: return make_comparison(t.field, t.op, t.string);
+            case Term::Kind::range:
+                return std::make_shared<NumberRangePredicate>(t.field, t.lo, t.loInclusive, t.hi, t.hiInclusive);
+            case Term::Kind::number_set: return std::make_shared<FieldSetPredicate<double>>(t.field, t.numbers);
+            case Term::Kind::string_set: return std::make_shared<FieldSetPredicate<std::string>>(t.field, t.strings);
+            case Term::Kind::and_:
+            case Term::Kind::or_:
+            {
+                std::vector<PredicatePtr> children;
+                for (auto& c: t.children)
+                    children.push_back(build(c));
+
+                if (t.kind == Term::Kind::and_)
+                    return std::make_shared<PredicateConjunction>(children.begin(), children.end());
+                return std::make_shared<PredicateDisjunction>(children.begin(), children.end());
+            }
+            }
+            return nullptr;
+        }
+    }
+
+    PredicatePtr rewrite(const Predicate& predicate)
+    {
+        Term t;
+        Describer d(t);
+        predicate.accept(d);
+
+        return build(simplify(std::move(t)));
+    }
+
+    bool never_matches(const Predicate& predicate) noexcept
+    {
+        return dynamic_cast<const FalsePredicate *>(&predicate) != nullptr;
+    }
+}
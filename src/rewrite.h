@@ -0,0 +1,19 @@
+#pragma once
+
+#include "types.h"
+
+
+namespace fastfood {
+
+    // Rewrites a predicate into an equivalent one that is cheaper to evaluate:
+    // - nested ANDs and ORs are flattened;
+    // - comparisons of a field with numbers in an AND are merged into a single interval check;
+    // - equalities of a field in an OR are merged into a set lookup;
+    // - contradictions such as `x < 1 && x > 2` fold to FalsePredicate, an AND with nothing left to check
+    //   folds to DummyPredicate.
+    // The predicate must not be bound yet.
+    PredicatePtr rewrite(const Predicate& predicate);
+
+    // True if the predicate is a contradiction folded by rewrite()
+    bool never_matches(const Predicate& predicate) noexcept;
+}
@@ -0,0 +1,305 @@
+#include "scan.h"
+#include "decompress.h"
+#include "mapped_file.h"
+#include "rewrite.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+
+namespace fastfood {
+    namespace {
+        constexpr size_t Min_Chunk_Size = 1024 * 1024;
+        constexpr size_t Max_Chunk_Size = 64 * 1024 * 1024;
+        constexpr size_t Chunks_Per_Thread = 4;   // to even out chunks of different selectivity
+        constexpr size_t Tasks_In_Flight_Per_Thread = 2; // bounds memory used by not yet written output
+
+        std::vector<string_view> split_on_records(string_view buffer, size_t chunk_size)
+        {
+            std::vector<string_view> chunks;
+            size_t start = 0;
+
+            while (start < buffer.size())
+            {
+                auto end = find_record_boundary(buffer, std::min(start + chunk_size, buffer.size()));
+                chunks.push_back(buffer.substr(start, end - start));
+                start = end;
+            }
+
+            return chunks;
+        }
+
+        // Part of a file scanned by a task of scan_files(): the records that start in [begin, end).
+        // The boundaries are found by the task so that only the sizes of the files are needed to split them.
+        struct FilePart
+        {
+            static constexpr size_t End_Of_File = std::numeric_limits<size_t>::max();
+
+            size_t file;
+            size_t begin, end;
+            bool whole;     // the file is not mappable and is scanned as a stream
+        };
+
+        std::vector<FilePart> split_files(const std::vector<std::string>& filenames, unsigned threads)
+        {
+            std::vector<size_t> sizes(filenames.size(), 0);
+            std::vector<bool> mappable(filenames.size());
+            size_t total = 0;
+
+            for (size_t i = 0; i < filenames.size(); ++i)
+            {
+                mappable[i] = MappedFile::is_mappable(filenames[i], sizes[i]);
+                total += sizes[i];
+            }
+
+            const auto chunk_size = std::max(Min_Chunk_Size, std::min(Max_Chunk_Size, total / (threads * Chunks_Per_Thread)));
+            std::vector<FilePart> parts;
+
+            for (size_t i = 0; i < filenames.size(); ++i)
+            {
+                if (!mappable[i])
+                {
+                    parts.push_back(FilePart{i, 0, FilePart::End_Of_File, true});
+                    continue;
+                }
+
+                // The last part takes whatever has been appended to the file since
+                size_t begin = 0;
+                for (; begin + chunk_size < sizes[i]; begin += chunk_size)
+                    parts.push_back(FilePart{i, begin, begin + chunk_size, false});
+                parts.push_back(FilePart{i, begin, FilePart::End_Of_File, false});
+            }
+
+            return parts;
+        }
+
+        template<class Input>
+        void scan_input(Input& input, const ScanQuery& query, std::ostream& os)
+        {
+            AdaptiveFilter filter(query.adaptive_filter());
+            RecsParser parser(input, query.schema, &filter.tree());
+            scan(parser, filter, query, os);
+            query.learn(filter.learnt());
+        }
+    }
+
+    ScanQuery::ScanQuery(const fql::Query& query, const FieldTypes *types)
+    : where(rewrite(*query.m_where))
+    {
+        for (auto& f: query.m_fields)
+        {
+            fields.emplace_back(f);
+            interestingFields.insert(fields.back());
+        }
+
+        where->visit_fields([this](Name f) { interestingFields.insert(f); });
+
+        schema = RecordSchema(interestingFields, types);
+        where->bind(schema);
+
+        m_learnt = where;
+    }
+
+    bool ScanQuery::never_matches() const noexcept
+    {
+        return fastfood::never_matches(*where);
+    }
+
+    PredicatePtr ScanQuery::adaptive_filter() const
+    {
+        std::lock_guard<std::mutex> lock(m_learntMutex);
+        return m_learnt->clone();
+    }
+
+    void ScanQuery::learn(PredicatePtr filter) const
+    {
+        std::lock_guard<std::mutex> lock(m_learntMutex);
+        m_learnt = std::move(filter);
+    }
+
+    void ScanQuery::print_stats(std::ostream& os) const
+    {
+        std::lock_guard<std::mutex> lock(m_learntMutex);
+        os << "Filter: ";
+        m_learnt->print(os);
+        os << "\n";
+        m_learnt->print_stats(os, 2);
+    }
+
+    constexpr unsigned AdaptiveFilter::Sample_Interval;
+
+    AdaptiveFilter::AdaptiveFilter(PredicatePtr tree)
+    : m_tree(std::move(tree))
+    , m_program(*m_tree)
+    {}
+
+    bool AdaptiveFilter::match_sample(const Record& record)
+    {
+        const auto res = m_tree->match_sample(record);
+
+        if (++m_samples % CompositePredicateMixin::Reorder_Interval == 0)
+            m_program = PredicateProgram(*m_tree);
+
+        return res;
+    }
+
+    void print_record(std::ostream& os, const Record& record, const std::vector<Name>& fields)
+    {
+        for (auto&& f: fields)
+        {
+            const auto& value = record.get(f);
+
+            if (value.is_null())
+                continue;
+
+            os << f.str() << ": " << value << "\n";
+        }
+        os << "\n";
+    }
+
+    void scan(RecsParser& parser, AdaptiveFilter& filter, const ScanQuery& query, std::ostream& os)
+    {
+        for (;;)
+        {
+            const auto sample = filter.sample_next();
+
+            if (!parser.next(!sample))
+                return;
+
+            const auto& record = parser.current();
+            const auto matches = sample ? filter.match_sample(record) : parser.matched() || filter.match(record);
+
+            if (matches)
+                print_record(os, record, query.fields);
+        }
+    }
+
+    void scan_buffer(string_view buffer, const ScanQuery& query, std::ostream& os)
+    {
+        scan_input(buffer, query, os);
+    }
+
+    size_t find_record_boundary(string_view buffer, size_t pos) noexcept
+    {
+        static const string_view eoe_line{"\nEOE\n"};
+
+        if (pos == 0 || pos >= buffer.size())
+            return std::min(pos, buffer.size());
+
+        const auto from = pos >= eoe_line.size() ? pos - eoe_line.size() : 0;
+        const auto found = buffer.substr(from).find(eoe_line);
+
+        return found == string_view::npos ? buffer.size() : from + found + eoe_line.size();
+    }
+
+    void parallel_scan(string_view buffer, const ScanQuery& query, unsigned threads, std::ostream& os)
+    {
+        if (threads <= 1 || buffer.size() <= Min_Chunk_Size)
+        {
+            scan_buffer(buffer, query, os);
+            return;
+        }
+
+        const auto chunk_size = std::max(Min_Chunk_Size, std::min(Max_Chunk_Size, buffer.size() / (threads * Chunks_Per_Thread)));
+        const auto chunks = split_on_records(buffer, chunk_size);
+
+        run_tasks(chunks.size(), threads, threads * Tasks_In_Flight_Per_Thread, OutputOrder::ordered,
+            [&](size_t i)
+            {
+                std::ostringstream out;
+                scan_buffer(chunks[i], query, out);
+                return out.str();
+            },
+            [&](const std::string& output) { os << output; });
+    }
+
+    void scan_stream(std::istream& is, const ScanQuery& query, std::ostream& os)
+    {
+        std::string head;
+        const auto compression = detect_compression(is, head);
+
+        if (head.empty())
+        {
+            scan_input(is, query, os);
+            return;
+        }
+
+        PrefixedStream input(std::move(head), is);
+
+        if (compression != Compression::none)
+        {
+            DecompressingStream decompressed(input, compression);
+            scan_input(decompressed, query, os);
+        }
+        else
+        {
+            scan_input(input, query, os);
+        }
+    }
+
+    void scan_file(const std::string& filename, const ScanQuery& query, unsigned threads, std::ostream& os)
+    {
+        if (MappedFile::is_mappable(filename))
+        {
+            MappedFile mapped_file(filename);
+
+            if (detect_compression(mapped_file.data()) == Compression::none)
+            {
+                parallel_scan(mapped_file.data(), query, threads, os);
+                return;
+            }
+        }
+
+        std::ifstream input_file(filename, std::ios_base::binary);
+        if (!input_file)
+            throw std::runtime_error("Can not open file '" + filename + "'");
+
+        scan_stream(input_file, query, os);
+    }
+
+    void scan_files(const std::vector<std::string>& filenames, const ScanQuery& query,
+                    unsigned threads, OutputOrder order, std::ostream& os)
+    {
+        const auto parts = split_files(filenames, threads);
+
+        run_tasks(parts.size(), threads, threads * Tasks_In_Flight_Per_Thread, order,
+            [&](size_t i)
+            {
+                const auto& part = parts[i];
+                const auto& filename = filenames[part.file];
+                std::ostringstream out;
+
+                // Let the kernel read the next file while this one is parsed
+                if (part.begin == 0 && part.file + 1 < filenames.size())
+                    MappedFile::prefetch(filenames[part.file + 1]);
+
+                if (part.whole)
+                {
+                    scan_file(filename, query, 1, out);
+                    return out.str();
+                }
+
+                MappedFile mapped_file(filename);
+                const auto data = mapped_file.data();
+
+                // A compressed file can only be scanned as a stream, the first part does it
+                if (detect_compression(data) != Compression::none)
+                {
+                    if (part.begin == 0)
+                        scan_file(filename, query, 1, out);
+                    return out.str();
+                }
+
+                const auto begin = find_record_boundary(data, part.begin);
+                const auto end = find_record_boundary(data, part.end);
+
+                if (begin < end)
+                    scan_buffer(data.substr(begin, end - begin), query, out);
+                return out.str();
+            },
+            [&](const std::string& output) { os << output; });
+    }
+}
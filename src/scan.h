@@ -0,0 +1,114 @@
+#pragma once
+
+#include "types.h"
+#include "field_types.h"
+#include "fql.h"
+#include "predicate_program.h"
+#include "recs_parser.h"
+#include "thread_pool.h"
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace fastfood {
+
+    // What a scan needs to know about the query
+    struct ScanQuery
+    {
+        // Kinds of the fields declared in `types` (if any) are used instead of the guessed ones
+        explicit ScanQuery(const fql::Query& query, const FieldTypes *types = nullptr);
+
+        // `where` is bound to `schema`
+        ScanQuery(const ScanQuery&) = delete;
+        ScanQuery& operator= (const ScanQuery&) = delete;
+
+        // True if `where` is a contradiction so there is no need to read any input
+        bool never_matches() const noexcept;
+
+        // A copy of `where` for an AdaptiveFilter. Its evaluation order adapts to the data; learn() takes it back
+        // so the copies made later start with the order found so far.
+        PredicatePtr adaptive_filter() const;
+        void learn(PredicatePtr filter) const;
+
+        // Prints the evaluation order learnt so far
+        void print_stats(std::ostream& os) const;
+
+        FieldSet interestingFields;
+        RecordSchema schema;        // of the records scanned
+        PredicatePtr where;         // the one of the query rewritten
+        std::vector<Name> fields;   // to print, in order
+
+    private:
+        mutable std::mutex m_learntMutex;
+        mutable PredicatePtr m_learnt;
+    };
+
+    // Filter of the records of one input. The predicate tree rejects records while they are parsed and
+    // the program compiled from it matches the complete records the tree has not matched.
+    // Every Sample_Interval-th record is parsed in full and matched by match_sample() of the tree instead, which times
+    // its AND and OR children on it to learn the order to evaluate them in (see CompositePredicateMixin).
+    // The program is compiled again as the order changes.
+    class AdaptiveFilter
+    {
+    public:
+        static constexpr unsigned Sample_Interval = 32;
+
+        explicit AdaptiveFilter(PredicatePtr tree);
+
+        // For the parser to filter records with while parsing
+        const Predicate& tree() const noexcept { return *m_tree; }
+
+        // The tree with the order learnt so far
+        const PredicatePtr& learnt() const noexcept { return m_tree; }
+
+        // True if the next record is a sample: it's to be parsed with no filter and matched by match_sample()
+        bool sample_next() noexcept { return m_records++ % Sample_Interval == 0; }
+
+        bool match(const Record& record) const noexcept { return m_program.match(record); }
+        bool match_sample(const Record& record);
+
+    private:
+        PredicatePtr m_tree;
+        PredicateProgram m_program;
+        unsigned m_records = 0;
+        unsigned m_samples = 0;
+    };
+
+    // Prints non-NULL `fields` of the record in the given order followed by an empty line
+    void print_record(std::ostream& os, const Record& record, const std::vector<Name>& fields);
+
+    // Scans the records of the buffer filtering them while parsing with an adaptive filter of the query
+    void scan_buffer(string_view buffer, const ScanQuery& query, std::ostream& os);
+
+    // Writes every record produced by the parser that matches the filter.
+    // The parser must filter records with the tree of the filter.
+    // Records are decided one at a time rather than in batches of columns: the tree rejects most records
+    // while they are parsed and skips the rest of their lines, so few values are left to compare in bulk,
+    // and a record it has not decided takes a single run of the program.
+    void scan(RecsParser& parser, AdaptiveFilter& filter, const ScanQuery& query, std::ostream& os);
+
+    // Returns the smallest position at or after `pos` where a record can start i.e. a position just after "\nEOE\n".
+    // Returns the buffer size if there is no such position.
+    size_t find_record_boundary(string_view buffer, size_t pos) noexcept;
+
+    // Splits the buffer into chunks on record boundaries and scans them with `threads` workers.
+    // Output is exactly the same as the one of the serial scan of the whole buffer.
+    void parallel_scan(string_view buffer, const ScanQuery& query, unsigned threads, std::ostream& os);
+
+    // Scans a possibly compressed stream
+    void scan_stream(std::istream& is, const ScanQuery& query, std::ostream& os);
+
+    // Scans a file: an uncompressed regular file is mapped and scanned with `threads` workers,
+    // anything else is scanned as a stream.
+    void scan_file(const std::string& filename, const ScanQuery& query, unsigned threads, std::ostream& os);
+
+    // Scans files concurrently, prefetching the file that comes next. Uncompressed regular files are split into
+    // chunks on record boundaries as parallel_scan() splits a buffer, so every worker is busy even with a few large
+    // files and the output held in memory is bounded by the chunks in flight. Any other file is a single task.
+    // Ordered output is the same as the one of the serial scan of the files one after another, unordered output
+    // is written a chunk at a time as the chunks are done.
+    void scan_files(const std::vector<std::string>& filenames, const ScanQuery& query,
+                    unsigned threads, OutputOrder order, std::ostream& os);
+}
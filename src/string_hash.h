@@ -0,0 +1,143 @@
+#pragma once
+
+#include <boost/utility/string_ref.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+namespace fastfood {
+    namespace detail {
+        inline void mul_128(uint64_t& a, uint64_t& b) noexcept
+        {
+#if defined(__SIZEOF_INT128__)
+            __extension__ typedef unsigned __int128 uint128;
+
+            const auto r = uint128(a) * b;
+            a = static_cast<uint64_t>(r);
+            b = static_cast<uint64_t>(r >> 64);
+#else
+            const uint64_t ha = a >> 32, hb = b >> 32, la = uint32_t(a), lb = uint32_t(b);
+            const uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+            const uint64_t t = rl + (rm0 << 32);
+            uint64_t c = t < rl;
+            const uint64_t lo = t + (rm1 << 32);
+            c += lo < t;
+            a = lo;
+            b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+        }
+
+        inline uint64_t mix(uint64_t a, uint64_t b) noexcept
+        {
+            mul_128(a, b);
+            return a ^ b;
+        }
+
+        inline uint64_t read_8(const char *p) noexcept
+        {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint64_t read_4(const char *p) noexcept
+        {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        // 1 to 3 bytes
+        inline uint64_t read_3(const char *p, size_t n) noexcept
+        {
+            return (uint64_t(uint8_t(p[0])) << 16) | (uint64_t(uint8_t(p[n >> 1])) << 8) | uint8_t(p[n - 1]);
+        }
+    }
+
+    // The structure and constants are the ones of wyhash (final version 4), a public domain hash:
+    // keys are read 4 or 8 bytes at a time and mixed with 64x64->128 bit multiplications.
+    inline uint64_t hash_bytes(const char *p, size_t n, uint64_t seed = 0) noexcept
+    {
+        using namespace detail;
+
+        static constexpr uint64_t secret[4] = {
+            0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+
+        seed ^= mix(seed ^ secret[0], secret[1]);
+        uint64_t a, b;
+
+        if (n <= 16)
+        {
+            if (n >= 4)
+            {
+                // Two overlapping pairs of 4 byte words cover any length from 4 to 16
+                const auto quarter = (n >> 3) << 2;
+                a = (read_4(p) << 32) | read_4(p + quarter);
+                b = (read_4(p + n - 4) << 32) | read_4(p + n - 4 - quarter);
+            }
+            else if (n > 0)
+            {
+                a = read_3(p, n);
+                b = 0;
+            }
+            else
+            {
+                a = b = 0;
+            }
+        }
+        else
+        {
+            auto i = n;
+
+            if (i > 48)
+            {
+                auto seed1 = seed, seed2 = seed;
+                do
+                {
+                    seed = mix(read_8(p) ^ secret[1], read_8(p + 8) ^ seed);
+                    seed1 = mix(read_8(p + 16) ^ secret[2], read_8(p + 24) ^ seed1);
+                    seed2 = mix(read_8(p + 32) ^ secret[3], read_8(p + 40) ^ seed2);
+                    p += 48;
+                    i -= 48;
+                }
+                while (i > 48);
+
+                seed ^= seed1 ^ seed2;
+            }
+
+            while (i > 16)
+            {
+                seed = mix(read_8(p) ^ secret[1], read_8(p + 8) ^ seed);
+                i -= 16;
+                p += 16;
+            }
+
+            a = read_8(p + i - 16);
+            b = read_8(p + i - 8);
+        }
+
+        a ^= secret[1];
+        b ^= seed;
+        mul_128(a, b);
+        return mix(a ^ secret[0] ^ n, b ^ secret[1]);
+    }
+
+    inline size_t hash_string(boost::string_ref s) noexcept
+    {
+        return static_cast<size_t>(hash_bytes(s.data(), s.size()));
+    }
+
+    // Hashes `count` strings into `hashes`. There are no dependencies between the iterations
+    // so the CPU overlaps the multiplications of consecutive keys.
+    inline void hash_strings(const boost::string_ref *keys, size_t count, size_t *hashes) noexcept
+    {
+        for (size_t i = 0; i < count; ++i)
+            hashes[i] = hash_string(keys[i]);
+    }
+
+    struct StringHash
+    {
+        size_t operator() (boost::string_ref s) const noexcept { return hash_string(s); }
+    };
+}
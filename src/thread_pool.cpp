@@ -0,0 +1,137 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace fastfood {
+    namespace {
+        struct TaskResult
+        {
+            std::string output;
+            std::exception_ptr error;
+            bool done = false;
+        };
+    }
+
+    void run_tasks(size_t count, unsigned threads, size_t in_flight, OutputOrder order,
+                   const std::function<std::string(size_t)>& task,
+                   const std::function<void(const std::string&)>& sink)
+    {
+        // No worker or no task in flight would leave the calling thread waiting forever
+        threads = std::max(threads, 1u);
+        in_flight = std::max<size_t>(in_flight, 1);
+
+        std::vector<TaskResult> results(count);
+        std::deque<size_t> completed;   // unordered mode only
+        std::mutex mux;
+        std::condition_variable cv;
+        size_t next_task = 0;   // guarded by mux
+        size_t written = 0;     //
+        bool stop = false;      //
+
+        auto worker = [&]
+        {
+            for (;;)
+            {
+                size_t i;
+
+                {
+                    std::unique_lock<std::mutex> lock(mux);
+                    cv.wait(lock, [&] { return stop || next_task == count || next_task < written + in_flight; });
+
+                    if (stop || next_task == count)
+                        return;
+
+                    i = next_task++;
+                }
+
+                TaskResult res;
+
+                try
+                {
+                    res.output = task(i);
+                }
+                catch (...)
+                {
+                    res.error = std::current_exception();
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mux);
+                    results[i] = std::move(res);
+                    results[i].done = true;
+
+                    if (order == OutputOrder::unordered)
+                        completed.push_back(i);
+                }
+
+                cv.notify_all();
+            }
+        };
+
+        std::vector<std::thread> workers;
+
+        auto join_all = [&]
+        {
+            {
+                std::lock_guard<std::mutex> lock(mux);
+                stop = true;
+            }
+            cv.notify_all();
+
+            for (auto& t: workers)
+                t.join();
+        };
+
+        try
+        {
+            for (unsigned i = 0; i < threads; ++i)
+                workers.emplace_back(worker);
+
+            for (size_t n = 0; n < count; ++n)
+            {
+                TaskResult res;
+
+                {
+                    std::unique_lock<std::mutex> lock(mux);
+
+                    size_t i = n;
+
+                    if (order == OutputOrder::ordered)
+                    {
+                        cv.wait(lock, [&] { return results[i].done; });
+                    }
+                    else
+                    {
+                        cv.wait(lock, [&] { return !completed.empty(); });
+                        i = completed.front();
+                        completed.pop_front();
+                    }
+
+                    res = std::move(results[i]);
+                    written = n + 1;
+                }
+
+                cv.notify_all();
+
+                if (res.error)
+                    std::rethrow_exception(res.error);
+
+                sink(res.output);
+            }
+        }
+        catch (...)
+        {
+            join_all();
+            throw;
+        }
+
+        join_all();
+    }
+}
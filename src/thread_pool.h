@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+
+namespace fastfood {
+
+    enum class OutputOrder { ordered, unordered };
+
+    // Runs tasks 0..count-1 on `threads` (at least one) worker threads. Every task produces an output which is passed to `sink`
+    // on the calling thread: in task order or, if unordered, as soon as the task is done.
+    // At most `in_flight` tasks are started ahead of the last output passed to the sink, which bounds
+    // the memory held by outputs waiting for their turn.
+    // The first exception thrown by a task (in output order) stops the pool and is rethrown.
+    void run_tasks(size_t count, unsigned threads, size_t in_flight, OutputOrder order,
+                   const std::function<std::string(size_t)>& task,
+                   const std::function<void(const std::string&)>& sink);
+}
@@ -0,0 +1,120 @@
+#include "types.h"
+#include "field_types.h"
+#include "number_parsers.h"
+#include <ostream>
+
+
+namespace fastfood {
+    constexpr size_t RecordSchema::npos;
+
+    const Field Record::s_null;
+
+    FieldKind guess_field_kind(string_view name) noexcept
+    {
+        if (name == "UserTime" || name == "SystemTime" || name == "Time")
+            return FieldKind::time;
+
+        if (name.starts_with("timer-") && name.ends_with("-time"))
+            return FieldKind::double_;
+
+        if (name.starts_with("timer-") && name.ends_with("-count"))
+            return FieldKind::count;
+
+        if (name.starts_with("counter-") && name.ends_with("-value"))
+            return FieldKind::double_;
+
+        return FieldKind::string;
+    }
+
+    bool decode_value(FieldKind kind, string_view raw, Field& res) noexcept
+    {
+        switch (kind)
+        {
+        case FieldKind::string:
+            res = raw;
+            return true;
+        case FieldKind::double_:
+        {
+            double v;
+            if (parse_double(raw, v) != ParseStatus::ok)
+                return false;
+            res = v;
+            return true;
+        }
+        case FieldKind::int64:
+        {
+            long v;
+            if (parse_long(raw, v) != ParseStatus::ok)
+                return false;
+            res = static_cast<int64_t>(v);
+            return true;
+        }
+        case FieldKind::count:
+        {
+            long v;
+            if (parse_long(raw, v) != ParseStatus::ok || v < 0)
+                return false;
+            res = static_cast<uint64_t>(v);
+            return true;
+        }
+        case FieldKind::time:
+        {
+            double v;
+            if (parse_component_time(raw, v) != ParseStatus::ok)
+                return false;
+            res = v;
+            return true;
+        }
+        }
+
+        return false;
+    }
+
+    RecordSchema::RecordSchema(const FieldSet& fields, const FieldTypes *types)
+    : m_names(fields.begin(), fields.end())
+    {
+        // Slots don't depend on the set iteration order
+        std::sort(m_names.begin(), m_names.end(), [](Name l, Name r) { return l.id() < r.id(); });
+
+        for (size_t i = 0; i < m_names.size(); ++i)
+        {
+            const auto id = m_names[i].id();
+
+            if (id >= m_slots.size())
+                m_slots.resize(id + 1, npos);
+
+            m_slots[id] = i;
+
+            FieldKind kind;
+            const auto declared = types && types->find(m_names[i], kind);
+
+            m_kinds.push_back(declared ? kind : guess_field_kind(m_names[i]));
+            m_declared.push_back(declared);
+        }
+    }
+
+    Field Record::decode(FieldKind kind, string_view raw) noexcept
+    {
+        Field res;
+
+        // A number is wanted from a string field
+        if (kind == FieldKind::string)
+            return decode_value(FieldKind::double_, raw, res) ? res : Field();
+
+        return decode_value(kind, raw, res) ? res : Field(raw);
+    }
+
+    std::ostream& operator<< (std::ostream& os, const Field& f)
+    {
+        switch (f.type())
+        {
+        case Field::Type::null: return os << "<NULL>";
+        case Field::Type::int64: return os << f.as_int64();
+        case Field::Type::uint64: return os << f.as_uint64();
+        case Field::Type::double_: return os << f.as_double();
+        case Field::Type::string: return os << f.as_string();
+        }
+
+        return os;
+    }
+}
@@ -1,17 +1,23 @@
 #pragma once
 
 #include "name.h"
+#include "flat_hash.h"
 #include <boost/utility/string_ref.hpp>
 #include <boost/functional/hash.hpp>
 #include <boost/optional.hpp>
 #include <boost/variant.hpp>
+#include <boost/logic/tribool.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <memory>
 #include <functional>
 #include <tuple>
+#include <vector>
 #include <iosfwd>
 #include <limits>
 #include <math.h>
@@ -27,91 +33,290 @@ namespace fastfood {
     template<class... Ts>
     using tuple = std::tuple<Ts...>;
 
-    using Field = variant<std::nullptr_t, string_view, double>; // TODO: add uint64_t when one is fully supported by JSON
-
-    class Record
+    // Value of a record field: NULL, a signed or unsigned integer, a double or a string.
+    // A tagged union of 16 bytes, the string length is limited to 4 GB.
+    class Field
     {
-    protected:
-        using Map = std::unordered_map<Name, Field>;
-
     public:
-        using const_iterator = Map::const_iterator; // TODO: filter NULL fields
+        enum class Type: uint8_t { null, int64, uint64, double_, string };
 
-        Field get(Name field) const noexcept
-        {
-            auto it = m_fields.find(field);
+        Field() noexcept: m_uint64(0), m_size(0), m_type(Type::null) {}
+        Field(std::nullptr_t) noexcept: Field() {}
+        Field(int64_t v) noexcept: m_int64(v), m_size(0), m_type(Type::int64) {}
+        Field(uint64_t v) noexcept: m_uint64(v), m_size(0), m_type(Type::uint64) {}
+        Field(double v) noexcept: m_double(v), m_size(0), m_type(Type::double_) {}
+        Field(string_view v) noexcept: m_data(v.data()), m_size(static_cast<uint32_t>(v.size())), m_type(Type::string) {}
+
+        Type type() const noexcept { return m_type; }
+
+        bool is_null() const noexcept { return m_type == Type::null; }
+        bool is_number() const noexcept { return m_type == Type::int64 || m_type == Type::uint64 || m_type == Type::double_; }
 
-            if (it == m_fields.end())
-                return Field{};
-            else
-                return it->second;
+        // Unchecked accessors, the field must be of the type
+        int64_t as_int64() const noexcept { return m_int64; }
+        uint64_t as_uint64() const noexcept { return m_uint64; }
+        double as_double() const noexcept { return m_double; }
+        string_view as_string() const noexcept { return {m_data, m_size}; }
+
+        // Value of any numeric type converted to double, `def` for other types
+        double to_double(double def = 0) const noexcept
+        {
+            switch (m_type)
+            {
+            case Type::int64: return static_cast<double>(m_int64);
+            case Type::uint64: return static_cast<double>(m_uint64);
+            case Type::double_: return m_double;
+            default: return def;
+            }
         }
 
-        bool has(Name field) const noexcept
+    private:
+        union
         {
-            auto it = m_fields.find(field);
+            int64_t m_int64;
+            uint64_t m_uint64;
+            double m_double;
+            const char *m_data;
+        };
+        uint32_t m_size;
+        Type m_type;
+    };
 
-            return it != m_fields.end() && it->second != Field{};
-        }
+    static_assert(sizeof(Field) <= 16, "Field must stay compact");
 
-        bool empty() const noexcept { return m_fields.empty(); }
+    std::ostream& operator<< (std::ostream& os, const Field& f);
 
-        const_iterator begin() const noexcept { return m_fields.begin(); }
-        const_iterator end() const noexcept { return m_fields.end(); }
+    using FieldSet = FlatHashSet<Name>;
 
-    protected:
-        Map m_fields;
+    // How the raw string of a field value is decoded. A value that can not be decoded stays a string.
+    enum class FieldKind: uint8_t
+    {
+        string,     // not decoded, converted to a number only when compared with one
+        double_,
+        int64,
+        count,      // uint64
+        time,       // "<msecs> msecs <usecs> usecs" to milliseconds as double
     };
 
-    class MutableRecord: public Record
+    // Kind of a field as recs files use it: UserTime, SystemTime and Time are times, timer-*-time and
+    // counter-*-value are doubles, timer-*-count are counts, the rest are strings
+    FieldKind guess_field_kind(string_view name) noexcept;
+
+    // Decodes the raw string of a value of the kind. Returns false if the string is not a value of the kind.
+    bool decode_value(FieldKind kind, string_view raw, Field& res) noexcept;
+
+    class FieldTypes;
+
+    // Assigns each field of a fixed set (usually the fields a query references) a slot,
+    // the index of the field value in a Record. Finding the slot of a name is an array access by the name id.
+    class RecordSchema
     {
     public:
-        MutableRecord() = default;
+        static constexpr size_t npos = static_cast<size_t>(-1);
 
-        explicit MutableRecord(size_t reserve, float max_load_factor = 1.0)
-        {
-            m_fields.max_load_factor(max_load_factor);
-            m_fields.reserve(reserve);
-        }
+        RecordSchema() = default;
 
-        template<class Value>
-        bool set(Name name, Value &&value)
+        // Kinds of the fields declared in `types` are taken from there, the rest are guessed from the names
+        explicit RecordSchema(const FieldSet& fields, const FieldTypes *types = nullptr);
+
+        size_t size() const noexcept { return m_names.size(); }
+
+        Name name(size_t slot) const noexcept { return m_names[slot]; }
+
+        FieldKind kind(size_t slot) const noexcept { return m_kinds[slot]; }
+
+        // True if the kind was declared by the user. Values of such fields are decoded while parsing.
+        bool declared(size_t slot) const noexcept { return m_declared[slot]; }
+
+        // Returns npos if the field is not in the schema
+        size_t slot(Name field) const noexcept { return field.id() < m_slots.size() ? m_slots[field.id()] : npos; }
+
+    private:
+        std::vector<Name> m_names;      // by slot
+        std::vector<FieldKind> m_kinds; // by slot
+        std::vector<bool> m_declared;   // by slot
+        std::vector<size_t> m_slots;    // by name id
+    };
+
+    // Values of the schema fields stored by slot, plus a bitmap of the fields present in the record.
+    // Values are set as raw strings and decoded according to the field kind on first access,
+    // the decoded value is cached until the field is set again or the record is cleared.
+    // The schema must outlive the record.
+    class Record
+    {
+    public:
+        // Iterates over the present fields only, values are decoded as at() returns them
+        class const_iterator
         {
-            auto it = m_fields.find(name);
+        public:
+            using value_type = std::pair<Name, const Field&>;
+            using reference = value_type;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using iterator_category = std::forward_iterator_tag;
+
+            const_iterator(const Record& record, size_t slot) noexcept
+            : m_record(&record)
+            , m_slot(slot)
+            {
+                skip_absent();
+            }
 
-            if (it == m_fields.end())
+            value_type operator* () const noexcept { return {m_record->m_schema->name(m_slot), m_record->at(m_slot)}; }
+
+            const_iterator& operator++ () noexcept
             {
-                m_fields.emplace(name, std::forward<Value>(value));
-                return true;
+                ++m_slot;
+                skip_absent();
+                return *this;
             }
-            else
+
+            const_iterator operator++ (int) noexcept
             {
-                auto res = it->second == Field{};
-                it->second = std::forward<Value>(value);
+                auto res = *this;
+                ++*this;
                 return res;
             }
+
+            bool operator== (const const_iterator& r) const noexcept { return m_slot == r.m_slot; }
+            bool operator!= (const const_iterator& r) const noexcept { return m_slot != r.m_slot; }
+
+        private:
+            void skip_absent() noexcept
+            {
+                while (m_slot < m_record->m_fields.size() && !m_record->has_slot(m_slot))
+                    ++m_slot;
+            }
+
+            const Record *m_record;
+            size_t m_slot;
+        };
+
+        explicit Record(const RecordSchema& schema)
+        : m_schema(&schema)
+        , m_fields(schema.size())
+        , m_present((schema.size() + 63) / 64)
+        , m_decoded(schema.size())
+        , m_decodedValid((schema.size() + 63) / 64)
+        {}
+
+        const RecordSchema& schema() const noexcept { return *m_schema; }
+
+        // Decoded value of the field in the slot or NULL if the field is not present. Accepts npos.
+        const Field& at(size_t slot) const noexcept
+        {
+            if (!has_slot(slot))
+                return s_null;
+
+            const auto& raw = m_fields[slot];
+
+            if (m_schema->kind(slot) == FieldKind::string || raw.type() != Field::Type::string)
+                return raw;
+
+            return decoded(slot);
         }
 
-        void clear()
+        const Field& get(Name field) const noexcept { return at(m_schema->slot(field)); }
+
+        // Value of the field as a number: a string field is converted to double (once per record),
+        // NULL if the field is not present or is not a number
+        const Field& number_at(size_t slot) const noexcept
         {
-            for (auto&& i: m_fields)
-                i.second = Field{};
+            const auto& f = at(slot);
+
+            if (f.type() != Field::Type::string)
+                return f;
+
+            return m_schema->kind(slot) == FieldKind::string ? decoded(slot) : s_null;
         }
+
+        const Field& number(Name field) const noexcept { return number_at(m_schema->slot(field)); }
+
+        bool has_slot(size_t slot) const noexcept
+        {
+            return slot < m_fields.size() && test(m_present, slot);
+        }
+
+        bool has(Name field) const noexcept { return has_slot(m_schema->slot(field)); }
+
+        bool empty() const noexcept
+        {
+            return std::all_of(m_present.begin(), m_present.end(), [](uint64_t w) { return w == 0; });
+        }
+
+        const_iterator begin() const noexcept { return {*this, 0}; }
+        const_iterator end() const noexcept { return {*this, m_fields.size()}; }
+
+    protected:
+        static bool test(const std::vector<uint64_t>& bitmap, size_t i) noexcept
+        {
+            return bitmap[i / 64] & (uint64_t(1) << (i % 64));
+        }
+
+        const Field& decoded(size_t slot) const noexcept
+        {
+            if (!test(m_decodedValid, slot))
+            {
+                m_decoded[slot] = decode(m_schema->kind(slot), m_fields[slot].as_string());
+                m_decodedValid[slot / 64] |= uint64_t(1) << (slot % 64);
+            }
+
+            return m_decoded[slot];
+        }
+
+        // A string that is not a value of the kind is returned as is except that for FieldKind::string
+        // (i.e. when a number is wanted) it's NULL
+        static Field decode(FieldKind kind, string_view raw) noexcept;
+
+        const RecordSchema *m_schema;
+        std::vector<Field> m_fields;        // by slot, meaningful only if the field is present
+        std::vector<uint64_t> m_present;    // bitmap by slot
+
+        // Decoded values cache
+        mutable std::vector<Field> m_decoded;           // by slot, meaningful only if valid
+        mutable std::vector<uint64_t> m_decodedValid;   // bitmap by slot
+
+        static const Field s_null;
     };
 
-    struct RecordPrinter: boost::static_visitor<std::ostream&>
+    class MutableRecord: public Record
     {
-        explicit RecordPrinter(std::ostream& os): m_os(os) {}
+    public:
+        explicit MutableRecord(const RecordSchema& schema): Record(schema) {}
 
-        std::ostream& operator() (std::nullptr_t) const { return m_os << "<NULL>"; }
-        std::ostream& operator() (string_view s) const { return m_os << s; }
-        std::ostream& operator() (double d) const { return m_os << d; }
+        // Returns true if the field was not present
+        template<class Value>
+        bool set_slot(size_t slot, Value &&value)
+        {
+            auto& word = m_present[slot / 64];
+            const auto bit = uint64_t(1) << (slot % 64);
+            const auto res = !(word & bit);
+
+            word |= bit;
+            m_fields[slot] = std::forward<Value>(value);
+            m_decodedValid[slot / 64] &= ~bit;
+            return res;
+        }
 
-        std::ostream& m_os;
+        // Fields that are not in the schema are ignored
+        template<class Value>
+        bool set(Name name, Value &&value)
+        {
+            const auto slot = m_schema->slot(name);
+            return slot != RecordSchema::npos && set_slot(slot, std::forward<Value>(value));
+        }
+
+        void clear() noexcept
+        {
+            std::fill(m_present.begin(), m_present.end(), 0);
+            std::fill(m_decodedValid.begin(), m_decodedValid.end(), 0);
+        }
     };
 
-    // TODO: use flat_unordered_set
-    using FieldSet = std::unordered_set<Name>;
+    class PredicateVisitor;
+    class Predicate;
+
+    using PredicatePtr = std::shared_ptr<Predicate>;
 
     class Predicate
     {
@@ -120,26 +325,40 @@ namespace fastfood {
 
         virtual bool match(const Record& record) const = 0;
 
+        // Matches a complete record as match() does and learns from it: composite predicates time their children
+        // to adapt the order they evaluate them in. Unlike match() it changes the predicate.
+        virtual bool match_sample(const Record& record) { return match(record); }
+
+        // Matches a record that is not completely parsed yet: a field that is not in the record
+        // may still come so its value is unknown. Returns indeterminate if the result depends on such fields.
+        virtual boost::tribool try_match(const Record& record) const = 0;
+
         virtual std::ostream& print(std::ostream& os) const = 0;
 
         virtual void visit_fields(const std::function<void(Name)>& visitor) const = 0;
-    };
 
-    using PredicatePtr = std::shared_ptr<Predicate>;
+        // Resolves the fields to slots of the schema. Matching a record of this schema then reads
+        // the slots directly, records of other schemas are still matched by field names.
+        virtual void bind(const RecordSchema& schema) = 0;
+
+        // Calls the visitor method that describes this predicate
+        virtual void accept(PredicateVisitor& visitor) const = 0;
+
+        // Deep copy including what was learnt about the data. A predicate matched by match_sample()
+        // must not be shared between threads.
+        virtual PredicatePtr clone() const = 0;
+
+        // Prints the evaluation order chosen for the children of composite predicates and why
+        virtual void print_stats(std::ostream& os, unsigned indent = 0) const = 0;
+    };
 
     namespace aggregators {
         namespace detail {
-            inline double get_double(const Field& f, double def = 0) noexcept
-            {
-                auto x = boost::get<double>(&f);
-                return x ? *x : def;
-            }
-
             struct Sum
             {
                 using type = double;
 
-                type operator() (type a, const Field& b) const noexcept { return a + get_double(b); }
+                type operator() (type a, const Field& b) const noexcept { return a + b.to_double(); }
 
                 static constexpr type initial_value() noexcept { return 0; }
             };
@@ -148,7 +367,7 @@ namespace fastfood {
             {
                 using type = double;
 
-                type operator() (type a, const Field& b) const noexcept { return std::min(a, get_double(b, initial_value())); }
+                type operator() (type a, const Field& b) const noexcept { return std::min(a, b.to_double(initial_value())); }
 
                 static constexpr type initial_value() noexcept { return std::numeric_limits<type>::quiet_NaN(); }
             };
@@ -157,14 +376,14 @@ namespace fastfood {
             {
                 using type = double;
 
-                type operator() (type a, const Field& b) const noexcept { return std::max(a, get_double(b, initial_value())); }
+                type operator() (type a, const Field& b) const noexcept { return std::max(a, b.to_double(initial_value())); }
 
                 static constexpr type initial_value() noexcept { return std::numeric_limits<type>::quiet_NaN(); }
             };
 
             struct Count
             {
-                using type = double; // TODO: use uint64_t
+                using type = uint64_t;
 
                 type operator() (type a, const Field&) const noexcept { return a + 1; }
 
@@ -173,13 +392,12 @@ namespace fastfood {
 
             struct Avg
             {
-                using type = std::pair<double, double>; // (sum, count). TODO: use uint64_t for count
+                using type = std::pair<double, uint64_t>; // (sum, count)
 
-                type operator() (const type& a, const Field& b) const
+                type operator() (const type& a, const Field& b) const noexcept
                 {
-                    auto x = boost::get<double>(&b);
-                    if (x)
-                        return {a.first + *x, a.second + 1};
+                    if (b.is_number())
+                        return {a.first + b.to_double(), a.second + 1};
                     else
                         return a;
                 }
@@ -0,0 +1,102 @@
+#include "catch.hpp"
+#include "field_types.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace fastfood;
+
+
+namespace {
+    FieldTypes read(const std::string& text)
+    {
+        std::istringstream is(text);
+        return FieldTypes::read(is, "schema");
+    }
+
+    // True if the field is declared and of the expected kind
+    bool declared(const FieldTypes& types, const char *name, FieldKind expected)
+    {
+        FieldKind kind;
+        return types.find(name, kind) && kind == expected;
+    }
+
+    std::string error_of(const std::string& text)
+    {
+        try
+        {
+            read(text);
+        }
+        catch (const std::runtime_error& e)
+        {
+            return e.what();
+        }
+        return "";
+    }
+}
+
+
+TEST_CASE("FieldTypes skips empty lines and comments", "[field_types]")
+{
+    const auto types = read("# sizes\n\nSize int\n   \n  # Size string\n");
+
+    CHECK(declared(types, "Size", FieldKind::int64));
+
+    FieldKind kind;
+    CHECK_FALSE(types.find("#", kind));
+    CHECK(error_of("Latency double # not a comment\n") ==
+          "Can not parse schema file 'schema' line 1: expected '<field or pattern> <string|double|int|count|time>'");
+
+    CHECK(read("").empty());
+    CHECK(read("# nothing\n\n").empty());
+}
+
+TEST_CASE("FieldTypes takes the first matching declaration", "[field_types]")
+{
+    const auto types = read("Size int\n"
+                            "*Size double\n"
+                            "Size string\n"
+                            "Block* count\n"
+                            "BlockTime time\n"
+                            "Request[AB] string\n");
+
+    // An exact name before a pattern matching it too
+    CHECK(declared(types, "Size", FieldKind::int64));
+    CHECK(declared(types, "BlockSize", FieldKind::double_));
+
+    // A pattern before an exact name matching it
+    CHECK(declared(types, "BlockTime", FieldKind::count));
+    CHECK(declared(types, "Blocks", FieldKind::count));
+
+    CHECK(declared(types, "RequestA", FieldKind::string));
+    CHECK(declared(types, "RequestB", FieldKind::string));
+
+    FieldKind kind;
+    CHECK_FALSE(types.find("RequestC", kind));
+    CHECK_FALSE(types.find("size", kind));
+    CHECK_FALSE(types.find("Sizes", kind));
+}
+
+TEST_CASE("FieldTypes reads every type", "[field_types]")
+{
+    const auto types = read("a string\nb double\nc int\nd count\ne time\n");
+
+    CHECK(declared(types, "a", FieldKind::string));
+    CHECK(declared(types, "b", FieldKind::double_));
+    CHECK(declared(types, "c", FieldKind::int64));
+    CHECK(declared(types, "d", FieldKind::count));
+    CHECK(declared(types, "e", FieldKind::time));
+}
+
+TEST_CASE("FieldTypes reports the line it can not parse", "[field_types]")
+{
+    const std::string expected = ": expected '<field or pattern> <string|double|int|count|time>'";
+
+    CHECK(error_of("Size\n") == "Can not parse schema file 'schema' line 1" + expected);
+    CHECK(error_of("# types\nSize int\n\nName text\n") == "Can not parse schema file 'schema' line 4" + expected);
+    CHECK(error_of("Size int int\n") == "Can not parse schema file 'schema' line 1" + expected);
+    CHECK(error_of("a string\nSize Int\n") == "Can not parse schema file 'schema' line 2" + expected);
+
+    CHECK_THROWS(FieldTypes::load("/nonexistent/schema"));
+}
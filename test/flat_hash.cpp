@@ -0,0 +1,181 @@
+#include "catch.hpp"
+#include "flat_hash.h"
+
+#include <set>
+#include <string>
+#include <unordered_set>
+
+using namespace fastfood;
+
+
+namespace {
+    using Strings = std::set<std::string>;
+
+    // All the keys collide so every lookup has to probe past the other keys
+    struct CollidingHash
+    {
+        size_t operator() (int) const noexcept { return 42; }
+    };
+}
+
+
+TEST_CASE("FlatHashSet inserts and finds keys", "[flat_hash]")
+{
+    FlatHashSet<int> set;
+
+    CHECK(set.empty());
+    CHECK(set.find(1) == set.end());
+
+    CHECK(set.insert(1).second);
+    CHECK(set.insert(2).second);
+    CHECK_FALSE(set.insert(1).second);
+
+    CHECK(set.size() == 2);
+    CHECK(set.count(1) == 1);
+    CHECK(set.count(3) == 0);
+    REQUIRE(set.find(2) != set.end());
+    CHECK(*set.find(2) == 2);
+}
+
+TEST_CASE("FlatHashSet keeps the keys over rehashes", "[flat_hash]")
+{
+    FlatHashSet<std::string> set;
+    std::vector<std::string> keys;
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        keys.push_back("a rather long key to be allocated on the heap #" + std::to_string(i));
+        CHECK(set.insert(keys.back()).second);
+    }
+
+    CHECK(set.size() == keys.size());
+
+    for (auto& k: keys)
+        CHECK(set.count(k) == 1);
+
+    CHECK(set.count("a rather long key to be allocated on the heap #5000") == 0);
+    CHECK(Strings(set.begin(), set.end()) == Strings(keys.begin(), keys.end()));
+
+    auto copy = set;
+    CHECK(copy.size() == set.size());
+    for (auto& k: keys)
+        CHECK(copy.count(k) == 1);
+}
+
+TEST_CASE("FlatHashSet::find_many finds every key", "[flat_hash]")
+{
+    FlatHashSet<int> set;
+    for (int i = 0; i < 100; i += 2)
+        set.insert(i);
+
+    std::vector<int> keys;
+    for (int i = 0; i < 100; ++i)
+        keys.push_back(i);
+
+    std::vector<FlatHashSet<int>::const_iterator> found;
+    set.find_many(keys.data(), keys.size(), std::back_inserter(found));
+
+    REQUIRE(found.size() == keys.size());
+    for (int i = 0; i < 100; ++i)
+        CHECK((found[i] != set.end()) == (i % 2 == 0));
+}
+
+TEST_CASE("FlatHashSet erases keys", "[flat_hash]")
+{
+    FlatHashSet<std::string> set{"a", "b", "c"};
+
+    CHECK(set.erase("b") == 1);
+    CHECK(set.erase("b") == 0);
+    CHECK(set.erase("x") == 0);
+
+    CHECK(set.size() == 2);
+    CHECK(set.count("a") == 1);
+    CHECK(set.count("b") == 0);
+    CHECK(set.count("c") == 1);
+    CHECK(Strings(set.begin(), set.end()) == Strings({"a", "c"}));
+
+    CHECK(set.insert("b").second);
+    CHECK(set.size() == 3);
+
+    // Erase while iterating
+    for (auto it = set.begin(); it != set.end();)
+        it = *it == "c" ? set.erase(it) : std::next(it);
+
+    CHECK(Strings(set.begin(), set.end()) == Strings({"a", "b"}));
+}
+
+TEST_CASE("FlatHashSet finds keys probed past tombstones", "[flat_hash]")
+{
+    FlatHashSet<int, CollidingHash> set;
+
+    // All the keys go to the same group and overflow to the next ones
+    for (int i = 0; i < 40; ++i)
+        set.insert(i);
+
+    for (int i = 0; i < 40; i += 3)
+        CHECK(set.erase(i) == 1);
+
+    for (int i = 0; i < 40; ++i)
+        CHECK(set.count(i) == (i % 3 != 0 ? 1u : 0u));
+
+    // Tombstones are reused and the keys are still unique
+    for (int i = 0; i < 40; ++i)
+        set.insert(i);
+
+    CHECK(set.size() == 40);
+    CHECK(std::distance(set.begin(), set.end()) == 40);
+}
+
+TEST_CASE("FlatHashSet cleans up tombstones", "[flat_hash]")
+{
+    FlatHashSet<int> set;
+    std::unordered_set<int> reference;
+
+    // Churn of a small number of live keys: tombstones pile up and have to be cleaned by rehashes
+    for (int i = 0; i < 20000; ++i)
+    {
+        set.insert(i);
+        reference.insert(i);
+
+        if (i >= 10)
+        {
+            CHECK(set.erase(i - 10) == 1);
+            reference.erase(i - 10);
+        }
+    }
+
+    CHECK(set.size() == reference.size());
+    for (auto k: reference)
+        CHECK(set.count(k) == 1);
+    CHECK(std::distance(set.begin(), set.end()) == 10);
+}
+
+TEST_CASE("FlatHashMap maps keys to values", "[flat_hash]")
+{
+    FlatHashMap<std::string, int> map;
+
+    map["one"] = 1;
+    map["two"] = 2;
+    ++map["one"];
+
+    CHECK(map.size() == 2);
+    CHECK(map["one"] == 2);
+    CHECK(map.find("two")->second == 2);
+    CHECK(map.find("three") == map.end());
+
+    CHECK(map.erase("one") == 1);
+    CHECK(map.find("one") == map.end());
+    CHECK(map["one"] == 0);
+}
+
+TEST_CASE("FlatHashSet clear empties the set", "[flat_hash]")
+{
+    FlatHashSet<int> set{1, 2, 3};
+    set.erase(2);
+    set.clear();
+
+    CHECK(set.empty());
+    CHECK(set.begin() == set.end());
+    CHECK(set.insert(2).second);
+    CHECK(set.size() == 1);
+}
@@ -0,0 +1,193 @@
+#include "catch.hpp"
+#include "number_parsers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+
+using namespace fastfood;
+
+
+namespace {
+    // A copy of the string in a buffer of its exact size so reading past the end is caught by sanitizers.
+    // An empty string still gets a byte as new char[0] can not be written to.
+    class ExactBuffer
+    {
+    public:
+        explicit ExactBuffer(const std::string& s): m_data(new char[std::max<size_t>(s.size(), 1)]), m_size(s.size())
+        {
+            if (!s.empty())
+                std::memcpy(m_data.get(), s.data(), s.size());
+        }
+
+        string_view view() const noexcept { return {m_data.get(), m_size}; }
+
+    private:
+        std::unique_ptr<char[]> m_data;
+        size_t m_size;
+    };
+
+    ParseStatus long_of(const std::string& s, long& res)
+    {
+        return parse_long(ExactBuffer(s).view(), res);
+    }
+
+    ParseStatus double_of(const std::string& s, double& res)
+    {
+        return parse_double(ExactBuffer(s).view(), res);
+    }
+}
+
+
+TEST_CASE("parse_long parses integers", "[number_parsers]")
+{
+    long v = -1;
+
+    CHECK(long_of("0", v) == ParseStatus::ok);
+    CHECK(v == 0);
+    CHECK(long_of("123456789012", v) == ParseStatus::ok);
+    CHECK(v == 123456789012);
+    CHECK(long_of("  -42 \t", v) == ParseStatus::ok);
+    CHECK(v == -42);
+    CHECK(long_of("+17", v) == ParseStatus::ok);
+    CHECK(v == 17);
+}
+
+TEST_CASE("parse_long handles the limits of long", "[number_parsers]")
+{
+    long v = 0;
+
+    CHECK(long_of(std::to_string(std::numeric_limits<long>::max()), v) == ParseStatus::ok);
+    CHECK(v == std::numeric_limits<long>::max());
+    CHECK(long_of(std::to_string(std::numeric_limits<long>::min()), v) == ParseStatus::ok);
+    CHECK(v == std::numeric_limits<long>::min());
+
+    CHECK(long_of("9223372036854775808", v) == ParseStatus::out_of_range);
+    CHECK(long_of("-9223372036854775809", v) == ParseStatus::out_of_range);
+    CHECK(long_of("18446744073709551616", v) == ParseStatus::out_of_range);
+    CHECK(long_of("123456789012345678901234567890", v) == ParseStatus::out_of_range);
+}
+
+TEST_CASE("parse_long skips leading zeros", "[number_parsers]")
+{
+    long v = -1;
+
+    CHECK(long_of("000000000000000000000000042", v) == ParseStatus::ok);
+    CHECK(v == 42);
+    CHECK(long_of("-0000000000000000000009223372036854775808", v) == ParseStatus::ok);
+    CHECK(v == std::numeric_limits<long>::min());
+
+    // All zeros at the very end of the input
+    CHECK(long_of(std::string(20, '0'), v) == ParseStatus::ok);
+    CHECK(v == 0);
+    CHECK(long_of(std::string(64, '0'), v) == ParseStatus::ok);
+    CHECK(v == 0);
+    CHECK(long_of("-" + std::string(33, '0'), v) == ParseStatus::ok);
+    CHECK(v == 0);
+}
+
+TEST_CASE("parse_long rejects what is not an integer", "[number_parsers]")
+{
+    long v = 0;
+
+    CHECK(long_of("", v) == ParseStatus::invalid);
+    CHECK(long_of("   ", v) == ParseStatus::invalid);
+    CHECK(long_of("-", v) == ParseStatus::invalid);
+    CHECK(long_of("+-1", v) == ParseStatus::invalid);
+    CHECK(long_of("12a", v) == ParseStatus::invalid);
+    CHECK(long_of("12 3", v) == ParseStatus::invalid);
+    CHECK(long_of("1.5", v) == ParseStatus::invalid);
+    CHECK(long_of("0x10", v) == ParseStatus::invalid);
+}
+
+TEST_CASE("parse_double parses decimal numbers", "[number_parsers]")
+{
+    double v = -1;
+
+    CHECK(double_of("0", v) == ParseStatus::ok);
+    CHECK(v == 0);
+    CHECK(double_of("1.5", v) == ParseStatus::ok);
+    CHECK(v == 1.5);
+    CHECK(double_of(" -2.25e2 ", v) == ParseStatus::ok);
+    CHECK(v == -225);
+    CHECK(double_of("+.5", v) == ParseStatus::ok);
+    CHECK(v == 0.5);
+    CHECK(double_of("5.", v) == ParseStatus::ok);
+    CHECK(v == 5);
+    CHECK(double_of("0.1", v) == ParseStatus::ok);
+    CHECK(v == 0.1);
+    CHECK(double_of("1.7976931348623157e308", v) == ParseStatus::ok);
+    CHECK(v == std::numeric_limits<double>::max());
+    CHECK(double_of("4.9406564584124654e-324", v) == ParseStatus::ok);
+    CHECK(v == std::numeric_limits<double>::denorm_min());
+    CHECK(double_of("1e-400", v) == ParseStatus::ok);
+    CHECK(v == 0);
+}
+
+TEST_CASE("parse_double rounds long mantissas correctly", "[number_parsers]")
+{
+    double v = 0;
+
+    CHECK(double_of("123456789012345678901234567890", v) == ParseStatus::ok);
+    CHECK(v == 123456789012345678901234567890.0);
+    CHECK(double_of("0.30000000000000000000000000001", v) == ParseStatus::ok);
+    CHECK(v == 0.3);
+    CHECK(double_of(std::string(40, '0') + "1.25", v) == ParseStatus::ok);
+    CHECK(v == 1.25);
+}
+
+TEST_CASE("parse_double handles zeros, signs and special values", "[number_parsers]")
+{
+    double v = 1;
+
+    CHECK(double_of(std::string(32, '0'), v) == ParseStatus::ok);
+    CHECK(v == 0);
+    CHECK(double_of("-0", v) == ParseStatus::ok);
+    CHECK(v == 0);
+    CHECK(std::signbit(v));
+    CHECK(double_of("-0.0e10", v) == ParseStatus::ok);
+    CHECK(std::signbit(v));
+
+    CHECK(double_of("nan", v) == ParseStatus::ok);
+    CHECK(std::isnan(v));
+    CHECK(double_of("-Infinity", v) == ParseStatus::ok);
+    CHECK(v == -std::numeric_limits<double>::infinity());
+    CHECK(double_of("inf", v) == ParseStatus::ok);
+    CHECK(v == std::numeric_limits<double>::infinity());
+
+    CHECK(double_of("1e400", v) == ParseStatus::out_of_range);
+}
+
+TEST_CASE("parse_double rejects what is not a number", "[number_parsers]")
+{
+    double v = 0;
+
+    CHECK(double_of("", v) == ParseStatus::invalid);
+    CHECK(double_of(" ", v) == ParseStatus::invalid);
+    CHECK(double_of("-", v) == ParseStatus::invalid);
+    CHECK(double_of(".", v) == ParseStatus::invalid);
+    CHECK(double_of("1.5x", v) == ParseStatus::invalid);
+    CHECK(double_of("1e", v) == ParseStatus::invalid);
+    CHECK(double_of("1e+", v) == ParseStatus::invalid);
+    CHECK(double_of("nana", v) == ParseStatus::invalid);
+    CHECK(double_of("1 2", v) == ParseStatus::invalid);
+}
+
+TEST_CASE("parse_component_time parses msecs and usecs", "[number_parsers]")
+{
+    double v = 0;
+
+    CHECK(parse_component_time(ExactBuffer("12 msecs 500 usecs").view(), v) == ParseStatus::ok);
+    CHECK(v == 12.5);
+    CHECK(parse_component_time(ExactBuffer(" 0 MSECS 0 Usecs ").view(), v) == ParseStatus::ok);
+    CHECK(v == 0);
+
+    CHECK(parse_component_time(ExactBuffer("").view(), v) == ParseStatus::invalid);
+    CHECK(parse_component_time(ExactBuffer("12 msecs").view(), v) == ParseStatus::invalid);
+    CHECK(parse_component_time(ExactBuffer("12 msecs 5 usecs x").view(), v) == ParseStatus::invalid);
+    CHECK(parse_component_time(ExactBuffer("12 msecs " + std::string(20, '0')).view(), v) == ParseStatus::invalid);
+    CHECK(parse_component_time(ExactBuffer("99999999999999999999 msecs 0 usecs").view(), v) == ParseStatus::out_of_range);
+}
@@ -0,0 +1,400 @@
+#include "catch.hpp"
+#include "predicate_program.h"
+#include "rewrite.h"
+
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+
+using namespace fastfood;
+
+
+namespace {
+    const double NaN = std::numeric_limits<double>::quiet_NaN();
+    const double Inf = std::numeric_limits<double>::infinity();
+
+    // A string field, a time and a count: numbers are decoded from the strings in different ways
+    const char *const Fields[] = {"x", "y", "Time", "timer-load-count"};
+
+    const char *const Raw_Values[] = {
+        "", "a", "b", "1", "-1", "0", "-0", "2.5", "1e3", "nan", "inf", "-inf", " 1 ", "1x",
+        "12 msecs 500 usecs", "0 msecs 0 usecs", "18446744073709551615",
+    };
+
+    const double Numbers[] = {-1, 0, -0.0, 1, 2.5, 12.5, 1000, NaN, Inf, -Inf};
+    const char *const Strings[] = {"", "a", "b", "1", "nan"};
+
+    class Generator
+    {
+    public:
+        explicit Generator(unsigned seed): m_random(seed) {}
+
+        PredicatePtr predicate(unsigned depth)
+        {
+            const auto kind = uniform(depth == 0 ? 7 : 9);
+
+            switch (kind)
+            {
+            case 0: return std::make_shared<DummyPredicate>();
+            case 1: return std::make_shared<FalsePredicate>();
+            case 2: return comparison(field(), pick(Numbers));
+            case 3: return comparison(field(), std::string(pick(Strings)));
+            case 4:
+                return std::make_shared<NumberRangePredicate>(field(), pick(Numbers), uniform(2), pick(Numbers), uniform(2));
+            case 5:
+            {
+                std::vector<double> values;
+                for (auto n = 1 + uniform(4); n--;)
+                    values.push_back(pick(Numbers));
+                return std::make_shared<FieldSetPredicate<double>>(field(), values);
+            }
+            case 6:
+            {
+                std::vector<std::string> values;
+                for (auto n = 1 + uniform(4); n--;)
+                    values.push_back(pick(Strings));
+                return std::make_shared<FieldSetPredicate<std::string>>(field(), values);
+            }
+            default:
+            {
+                std::vector<PredicatePtr> children;
+                for (auto n = 1 + uniform(4); n--;)
+                    children.push_back(predicate(depth - 1));
+
+                if (kind == 7)
+                    return std::make_shared<PredicateConjunction>(children.begin(), children.end());
+                return std::make_shared<PredicateDisjunction>(children.begin(), children.end());
+            }
+            }
+        }
+
+        // Each field is missing, a raw string as the parser sets it or an already decoded value
+        void fill(MutableRecord& record)
+        {
+            record.clear();
+
+            for (auto f: Fields)
+            {
+                switch (uniform(4))
+                {
+                case 0: break;
+                case 1: record.set(Name(f), Field(pick(Numbers))); break;
+                default: record.set(Name(f), Field(string_view(pick(Raw_Values)))); break;
+                }
+            }
+        }
+
+    private:
+        unsigned uniform(unsigned n) { return std::uniform_int_distribution<unsigned>(0, n - 1)(m_random); }
+
+        template<class T, size_t N>
+        const T& pick(const T (&values)[N]) { return values[uniform(N)]; }
+
+        std::string field() { return pick(Fields); }
+
+        template<class T>
+        PredicatePtr comparison(const std::string& field, const T& val)
+        {
+            switch (uniform(6))
+            {
+            case 0: return std::make_shared<BinaryFieldPredicate<EqualTo, T>>(field, val);
+            case 1: return std::make_shared<BinaryFieldPredicate<NotEqualTo, T>>(field, val);
+            case 2: return std::make_shared<BinaryFieldPredicate<Less, T>>(field, val);
+            case 3: return std::make_shared<BinaryFieldPredicate<LessEqual, T>>(field, val);
+            case 4: return std::make_shared<BinaryFieldPredicate<Greater, T>>(field, val);
+            default: return std::make_shared<BinaryFieldPredicate<GreaterEqual, T>>(field, val);
+            }
+        }
+
+        std::mt19937 m_random;
+    };
+
+    std::string to_string(const Predicate& predicate)
+    {
+        std::ostringstream os;
+        predicate.print(os);
+        return os.str();
+    }
+
+    std::string to_string(const PredicateProgram& program)
+    {
+        std::ostringstream os;
+        program.print(os);
+        return os.str();
+    }
+
+    std::string to_string(const Record& record)
+    {
+        std::ostringstream os;
+        for (auto field: record)
+            os << field.first << " = " << field.second << "\n";
+        return os.str();
+    }
+}
+
+
+TEST_CASE("PredicateProgram matches the records the predicate matches", "[predicate_program]")
+{
+    FieldSet fields;
+    for (auto f: Fields)
+        fields.insert(Name(f));
+    const RecordSchema schema(fields);
+
+    Generator generator(20240521);
+    MutableRecord record(schema);
+    size_t matches = 0, misses = 0;
+
+    for (int i = 0; i < 2000; ++i)
+    {
+        auto predicate = generator.predicate(3);
+        auto rewritten = rewrite(*predicate);
+
+        predicate->bind(schema);
+        rewritten->bind(schema);
+
+        const PredicateProgram program(*predicate);
+        const PredicateProgram rewritten_program(*rewritten);
+
+        INFO(to_string(*predicate));
+        INFO(to_string(program));
+
+        for (int j = 0; j < 50; ++j)
+        {
+            generator.fill(record);
+
+            const auto expected = predicate->match(record);
+            const auto matched = program.match(record);
+            const auto run = program.run(record);
+            const auto rewritten_matched = rewritten_program.match(record);
+            ++(expected ? matches : misses);
+
+            // Checking each record would make millions of assertions
+            if (matched != expected || run != expected || rewritten_matched != expected)
+            {
+                INFO(to_string(record));
+                INFO(to_string(*rewritten));
+                INFO(to_string(rewritten_program));
+
+                CHECK(matched == expected);
+                CHECK(run == expected);
+                CHECK(rewritten_matched == expected);
+            }
+        }
+    }
+
+    // Neither result is so rare that the other one is all that is checked
+    CHECK(matches > misses / 10);
+    CHECK(misses > matches / 10);
+}
+
+namespace {
+    using Shape = PredicateProgram::Shape;
+
+    PredicatePtr number(const std::string& field, CompOp op, double val)
+    {
+        switch (op)
+        {
+        case CompOp::eq: return std::make_shared<BinaryFieldPredicate<EqualTo, double>>(field, val);
+        case CompOp::ne: return std::make_shared<BinaryFieldPredicate<NotEqualTo, double>>(field, val);
+        case CompOp::lt: return std::make_shared<BinaryFieldPredicate<Less, double>>(field, val);
+        case CompOp::le: return std::make_shared<BinaryFieldPredicate<LessEqual, double>>(field, val);
+        case CompOp::gt: return std::make_shared<BinaryFieldPredicate<Greater, double>>(field, val);
+        case CompOp::ge: return std::make_shared<BinaryFieldPredicate<GreaterEqual, double>>(field, val);
+        }
+        return nullptr;
+    }
+
+    PredicatePtr string_eq(const std::string& field, const std::string& val)
+    {
+        return std::make_shared<BinaryFieldPredicate<EqualTo, std::string>>(field, val);
+    }
+
+    PredicatePtr all(std::vector<PredicatePtr> children)
+    {
+        return std::make_shared<PredicateConjunction>(children.begin(), children.end());
+    }
+
+    PredicatePtr any(std::vector<PredicatePtr> children)
+    {
+        return std::make_shared<PredicateDisjunction>(children.begin(), children.end());
+    }
+
+    // Compiles the predicate, checks the shape the program is matched by and that the kernel of the shape
+    // agrees with the interpreter and the predicate
+    void check_shape(const PredicatePtr& predicate, Shape shape)
+    {
+        FieldSet fields;
+        for (auto f: Fields)
+            fields.insert(Name(f));
+        const RecordSchema schema(fields);
+
+        predicate->bind(schema);
+        const PredicateProgram program(*predicate);
+
+        INFO(to_string(*predicate));
+        INFO(to_string(program));
+        CHECK(static_cast<int>(program.shape()) == static_cast<int>(shape));
+
+        Generator generator(7);
+        MutableRecord record(schema);
+        size_t mismatches = 0;
+
+        for (int i = 0; i < 2000; ++i)
+        {
+            generator.fill(record);
+
+            const auto expected = predicate->match(record);
+            mismatches += program.match(record) != expected || program.run(record) != expected;
+        }
+
+        CHECK(mismatches == 0);
+    }
+}
+
+
+TEST_CASE("PredicateProgram matches a single comparison by a kernel of its operator", "[predicate_program]")
+{
+    check_shape(number("x", CompOp::eq, 1), Shape::number_eq);
+    check_shape(number("Time", CompOp::ne, 12.5), Shape::number_ne);
+    check_shape(number("x", CompOp::lt, 0), Shape::number_lt);
+    check_shape(number("timer-load-count", CompOp::le, 1000), Shape::number_le);
+    check_shape(number("y", CompOp::gt, -1), Shape::number_gt);
+    check_shape(number("x", CompOp::ge, NaN), Shape::number_ge);
+    check_shape(string_eq("x", "a"), Shape::string_eq);
+
+    // The other single tests are an AND of one
+    check_shape(std::make_shared<BinaryFieldPredicate<NotEqualTo, std::string>>("x", "a"), Shape::all_1);
+    check_shape(std::make_shared<BinaryFieldPredicate<Less, std::string>>("y", "b"), Shape::all_1);
+    check_shape(std::make_shared<NumberRangePredicate>("x", -1, true, 2.5, false), Shape::all_1);
+    check_shape(std::make_shared<FieldSetPredicate<double>>("x", std::vector<double>{0, 1, 2.5}), Shape::all_1);
+    check_shape(std::make_shared<FieldSetPredicate<std::string>>("y", std::vector<std::string>{"a", "1"}), Shape::all_1);
+    check_shape(std::make_shared<DummyPredicate>(), Shape::all_1);
+}
+
+TEST_CASE("PredicateProgram matches short ANDs and ORs of comparisons by kernels", "[predicate_program]")
+{
+    check_shape(all({number("x", CompOp::gt, 0), string_eq("y", "a")}), Shape::all_2);
+    check_shape(all({number("x", CompOp::gt, 0), number("x", CompOp::lt, 2.5), string_eq("y", "a")}), Shape::all_3);
+    check_shape(all({number("x", CompOp::ge, -1), all({string_eq("y", "1"), number("Time", CompOp::lt, 100)}),
+                     std::make_shared<FieldSetPredicate<double>>("timer-load-count", std::vector<double>{0, 1})}),
+                Shape::all_4);
+
+    check_shape(any({number("x", CompOp::eq, 1), string_eq("y", "b")}), Shape::any_2);
+    check_shape(any({number("x", CompOp::eq, 1), string_eq("y", "b"), number("Time", CompOp::ge, 12.5)}), Shape::any_3);
+    check_shape(any({any({number("x", CompOp::eq, 1), string_eq("x", "a")}),
+                     std::make_shared<NumberRangePredicate>("Time", 0, false, 12.5, true)}),
+                Shape::any_3);
+    check_shape(any({number("x", CompOp::eq, 1), string_eq("y", "b"), number("Time", CompOp::ge, 12.5),
+                     std::make_shared<FieldSetPredicate<std::string>>("x", std::vector<std::string>{"", "b"})}),
+                Shape::any_4);
+}
+
+TEST_CASE("PredicateProgram instantiates kernels of two comparisons for their operators", "[predicate_program]")
+{
+    FieldSet fields;
+    for (auto f: Fields)
+        fields.insert(Name(f));
+    const RecordSchema schema(fields);
+
+    const auto typed = [&](const PredicatePtr& predicate) {
+        predicate->bind(schema);
+        return PredicateProgram(*predicate).typed_kernel();
+    };
+
+    const auto x_gt_0 = number("x", CompOp::gt, 0);
+    const auto y_is_a = string_eq("y", "a");
+    const auto y_ne_a = std::make_shared<BinaryFieldPredicate<NotEqualTo, std::string>>("y", "a");
+    const auto x_in = std::make_shared<FieldSetPredicate<double>>("x", std::vector<double>{0, 1});
+
+    CHECK(typed(all({x_gt_0, y_is_a})));
+    CHECK(typed(all({y_is_a, number("Time", CompOp::le, 12.5)})));
+    CHECK(typed(any({number("x", CompOp::eq, 1), number("x", CompOp::ne, 2)})));
+    CHECK(typed(any({y_is_a, string_eq("x", "b")})));
+
+    // Pairs with other tests switch on each of them
+    CHECK_FALSE(typed(all({x_gt_0, y_ne_a})));
+    CHECK_FALSE(typed(any({x_in, y_is_a})));
+    CHECK_FALSE(typed(all({std::make_shared<DummyPredicate>(), x_gt_0})));
+
+    // Only pairs have typed kernels
+    CHECK_FALSE(typed(x_gt_0));
+    CHECK_FALSE(typed(all({x_gt_0, y_is_a, number("Time", CompOp::lt, 1)})));
+
+    for (auto op: {CompOp::eq, CompOp::ne, CompOp::lt, CompOp::le, CompOp::gt, CompOp::ge})
+    {
+        check_shape(all({number("x", op, 1), number("Time", CompOp::gt, 0)}), Shape::all_2);
+        check_shape(all({string_eq("y", "b"), number("x", op, 2.5)}), Shape::all_2);
+        check_shape(any({number("timer-load-count", op, 1000), string_eq("x", "1")}), Shape::any_2);
+        check_shape(any({number("x", op, NaN), number("y", op, -1)}), Shape::any_2);
+    }
+    check_shape(all({x_gt_0, y_ne_a}), Shape::all_2);
+    check_shape(any({x_in, y_is_a}), Shape::any_2);
+}
+
+TEST_CASE("PredicateProgram interprets programs of other shapes", "[predicate_program]")
+{
+    // Longer than a kernel
+    check_shape(all({number("x", CompOp::gt, 0), number("x", CompOp::lt, 2.5), string_eq("y", "a"),
+                     number("Time", CompOp::lt, 100), number("timer-load-count", CompOp::ne, 0)}),
+                Shape::generic);
+    check_shape(any({number("x", CompOp::eq, 1), number("x", CompOp::eq, 2), number("x", CompOp::eq, 3),
+                     number("x", CompOp::eq, 4), number("x", CompOp::eq, 5)}),
+                Shape::generic);
+
+    // AND of ORs and OR of ANDs
+    check_shape(all({any({number("x", CompOp::eq, 1), string_eq("y", "a")}), number("Time", CompOp::lt, 100)}),
+                Shape::generic);
+    check_shape(any({all({number("x", CompOp::eq, 1), string_eq("y", "a")}), number("Time", CompOp::lt, 100)}),
+                Shape::generic);
+
+    // Never matches
+    check_shape(std::make_shared<FalsePredicate>(), Shape::generic);
+    check_shape(all({number("x", CompOp::eq, 1), std::make_shared<FalsePredicate>()}), Shape::generic);
+}
+
+TEST_CASE("PredicateProgram keeps the values compared with in tables of operands", "[predicate_program]")
+{
+    FieldSet fields;
+    for (auto f: Fields)
+        fields.insert(Name(f));
+    const RecordSchema schema(fields);
+
+    const auto predicate = any({all({number("x", CompOp::gt, 0), string_eq("y", "a"), number("x", CompOp::lt, 2.5)}),
+                                std::make_shared<NumberRangePredicate>("Time", 0, false, 12.5, true),
+                                std::make_shared<FieldSetPredicate<double>>("x", std::vector<double>{1, 2}),
+                                std::make_shared<FieldSetPredicate<std::string>>("y", std::vector<std::string>{"b"}),
+                                string_eq("x", "c")});
+    predicate->bind(schema);
+    const PredicateProgram program(*predicate);
+
+    const auto& operands = program.operands();
+    CHECK(operands.numbers == (std::vector<double>{0, 2.5}));
+    REQUIRE(operands.strings.size() == 2);
+    CHECK(operands.strings[0] == "a");
+    CHECK(operands.strings[1] == "c");
+    REQUIRE(operands.ranges.size() == 1);
+    CHECK(operands.ranges[0].lo == 0);
+    CHECK(operands.ranges[0].hi == 12.5);
+    CHECK_FALSE(operands.ranges[0].lo_inclusive);
+    CHECK(operands.ranges[0].hi_inclusive);
+    REQUIRE(operands.number_sets.size() == 1);
+    CHECK(operands.number_sets[0]->size() == 2);
+    REQUIRE(operands.string_sets.size() == 1);
+    CHECK(operands.string_sets[0]->size() == 1);
+
+    std::vector<uint32_t> indexes;
+    for (const auto& i: program.code())
+        indexes.push_back(i.operand);
+    CHECK(indexes == (std::vector<uint32_t>{0, 0, 1, 0, 0, 0, 1}));
+
+    const auto slot = [&](const char *field) { return std::to_string(schema.slot(Name(field))); };
+    CHECK(to_string(program) ==
+          "0: num > [" + slot("x") + "] 0 ? 1 : 3\n"
+          "1: str == [" + slot("y") + "] \"a\" ? 2 : 3\n"
+          "2: num < [" + slot("x") + "] 2.5 ? match : 3\n"
+          "3: num range [" + slot("Time") + "] (0, 12.5] ? match : 4\n"
+          "4: num in [" + slot("x") + "] 2 values ? match : 5\n"
+          "5: str in [" + slot("y") + "] 1 values ? match : 6\n"
+          "6: str == [" + slot("x") + "] \"c\" ? match : no match\n");
+}
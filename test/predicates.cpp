@@ -0,0 +1,94 @@
+#include "catch.hpp"
+#include "predicate_program.h"
+
+#include <sstream>
+#include <string>
+
+using namespace fastfood;
+
+
+namespace {
+    // Slot of the field the compiled predicate tests first i.e. of its first child in the evaluation order
+    size_t first_slot(const Predicate& predicate)
+    {
+        return PredicateProgram(predicate).code().front().slot;
+    }
+}
+
+
+TEST_CASE("Composite predicates learn the evaluation order from samples only", "[predicates]")
+{
+    const RecordSchema schema(FieldSet{Name("x"), Name("y")});
+    const auto x = schema.slot(Name("x")), y = schema.slot(Name("y"));
+
+    MutableRecord record(schema);
+    record.set(Name("x"), string_view("a"));
+    record.set(Name("y"), string_view("a"));
+
+    // The second child decides every record
+    PredicateConjunction conjunction{
+        std::make_shared<BinaryFieldPredicate<EqualTo, std::string>>("y", "a"),
+        std::make_shared<BinaryFieldPredicate<EqualTo, std::string>>("x", "b"),
+    };
+    conjunction.bind(schema);
+
+    for (unsigned i = 0; i < 10 * CompositePredicateMixin::Reorder_Interval; ++i)
+        CHECK_FALSE(conjunction.match(record));
+
+    CHECK(first_slot(conjunction) == y);
+
+    for (unsigned i = 0; i < CompositePredicateMixin::Reorder_Interval; ++i)
+        CHECK_FALSE(conjunction.match_sample(record));
+
+    CHECK(first_slot(conjunction) == x);
+}
+
+TEST_CASE("A disjunction tries the child that passes first", "[predicates]")
+{
+    const RecordSchema schema(FieldSet{Name("x"), Name("y")});
+    const auto y = schema.slot(Name("y"));
+
+    MutableRecord record(schema);
+    record.set(Name("y"), string_view("a"));
+
+    PredicateDisjunction disjunction{
+        std::make_shared<BinaryFieldPredicate<EqualTo, std::string>>("x", "a"),
+        std::make_shared<BinaryFieldPredicate<EqualTo, std::string>>("y", "a"),
+    };
+    disjunction.bind(schema);
+
+    for (unsigned i = 0; i < CompositePredicateMixin::Reorder_Interval; ++i)
+        CHECK(disjunction.match_sample(record));
+
+    CHECK(first_slot(disjunction) == y);
+
+    // A copy starts with the order learnt
+    CHECK(first_slot(*disjunction.clone()) == y);
+}
+
+TEST_CASE("Composite predicates print the totals of the samples", "[predicates]")
+{
+    const RecordSchema schema(FieldSet{Name("x"), Name("y")});
+
+    MutableRecord record(schema);
+    record.set(Name("y"), string_view("a"));
+
+    PredicateDisjunction disjunction{
+        std::make_shared<BinaryFieldPredicate<EqualTo, std::string>>("x", "a"),
+        std::make_shared<BinaryFieldPredicate<EqualTo, std::string>>("y", "a"),
+    };
+    disjunction.bind(schema);
+
+    // Reordered twice: the weights the order is chosen by decay, the numbers printed do not
+    for (unsigned i = 0; i < 2 * CompositePredicateMixin::Reorder_Interval; ++i)
+        disjunction.match_sample(record);
+
+    std::ostringstream os;
+    disjunction.print_stats(os, 0);
+
+    const auto stats = os.str();
+    INFO(stats);
+    CHECK(stats.find("y == \"a\": passes 100% of 128 samples") != std::string::npos);
+    CHECK(stats.find("x == \"a\": passes 0% of 64 samples") != std::string::npos);
+    CHECK(stats.find("y == \"a\"") < stats.find("x == \"a\""));
+}
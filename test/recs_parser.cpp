@@ -0,0 +1,324 @@
+#include "catch.hpp"
+#include "field_types.h"
+#include "fql.h"
+#include "recs_parser.h"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace fastfood;
+
+
+namespace {
+    // Block sizes of the stream mode: the smallest ones make refills land anywhere in a line, "\nEOE\n" included
+    const size_t Block_Sizes[] = {1, 2, 3, 4, 5, 7, 16, RecsParser::Stream_Block_Size};
+
+    // A record is "name=value" of the fields of the schema present in it, sorted by name and separated by spaces
+    using Records = std::vector<std::string>;
+
+    std::string to_string(const Record& record)
+    {
+        std::vector<std::string> fields;
+        for (auto field: record)
+        {
+            std::ostringstream os;
+            os << field.first << "=" << field.second;
+            fields.push_back(os.str());
+        }
+        std::sort(fields.begin(), fields.end());
+
+        std::string res;
+        for (auto& f: fields)
+            res += (res.empty() ? "" : " ") + f;
+        return res;
+    }
+
+    // How the parser is driven: the records are parsed with the filter (and still matched against it
+    // unless the parser has matched them), without it, or every other one without it as a sample is
+    enum class Filtering { on, off, alternate };
+
+    class Query
+    {
+    public:
+        explicit Query(const std::string& query)
+        : m_query(fql::parse_query(query))
+        {
+            FieldSet fields;
+            for (auto& f: m_query.m_fields)
+                fields.insert(Name(f));
+            m_query.m_where->visit_fields([&](Name f) { fields.insert(f); });
+
+            m_schema = RecordSchema(fields);
+            m_query.m_where->bind(m_schema);
+        }
+
+        Records parse(RecsParser& parser, Filtering filtering) const
+        {
+            Records res;
+
+            for (size_t n = 0;; ++n)
+            {
+                const auto filtered = filtering == Filtering::on || (filtering == Filtering::alternate && n % 2);
+
+                if (!parser.next(filtered))
+                    return res;
+
+                // A record the parser has matched must be one the filter matches
+                if (parser.matched())
+                    CHECK(m_query.m_where->match(parser.current()));
+
+                if (m_query.m_where->match(parser.current()))
+                    res.push_back(to_string(parser.current()));
+            }
+        }
+
+        Records parse_buffer(const std::string& input, Filtering filtering) const
+        {
+            RecsParser parser(string_view(input), m_schema, filter(filtering));
+            return parse(parser, filtering);
+        }
+
+        Records parse_stream(const std::string& input, size_t block_size, Filtering filtering) const
+        {
+            std::istringstream is(input);
+            RecsParser parser(is, m_schema, filter(filtering), block_size);
+            return parse(parser, filtering);
+        }
+
+        const RecordSchema& schema() const noexcept { return m_schema; }
+        const Predicate& where() const noexcept { return *m_query.m_where; }
+
+    private:
+        const Predicate *filter(Filtering filtering) const
+        {
+            return filtering == Filtering::off ? nullptr : m_query.m_where.get();
+        }
+
+        fql::Query m_query;
+        RecordSchema m_schema;
+    };
+
+    // The input parsed in every mode, with and without the filter, gives the expected records
+    void check_parsed(const std::string& input, const std::string& query, const Records& expected)
+    {
+        const Query q(query);
+        INFO(query);
+
+        for (auto filtering: {Filtering::on, Filtering::off, Filtering::alternate})
+        {
+            INFO("filtering " << static_cast<int>(filtering));
+            CHECK(q.parse_buffer(input, filtering) == expected);
+
+            for (auto block_size: Block_Sizes)
+            {
+                INFO("block size " << block_size);
+                CHECK(q.parse_stream(input, block_size, filtering) == expected);
+            }
+        }
+    }
+
+    // Every mode fails on the input
+    void check_error(const std::string& input, const std::string& query, const std::string& error)
+    {
+        const Query q(query);
+        INFO(input);
+
+        for (auto filtering: {Filtering::on, Filtering::off})
+        {
+            CHECK_THROWS_WITH(q.parse_buffer(input, filtering), error);
+
+            for (auto block_size: Block_Sizes)
+                CHECK_THROWS_WITH(q.parse_stream(input, block_size, filtering), error);
+        }
+    }
+}
+
+
+TEST_CASE("RecsParser parses the fields of the schema", "[recs_parser]")
+{
+    const std::string input =
+        "Op=Get\nSize=5\nHost=a\nEOE\n"
+        "Size=7\nOp=Put\nNote=\nEOE\n"
+        "Host=b\nEOE\n"
+        "EOE\n";
+
+    check_parsed(input, "select Op, Size", {"Op=Get Size=5", "Op=Put Size=7", "", ""});
+    check_parsed(input, "select Op, Size where Size > 5", {"Op=Put Size=7"});
+    check_parsed(input, "select Op where Op = \"Get\" or Op = \"Put\"", {"Op=Get", "Op=Put"});
+    check_parsed(input, "select Note, Host where Host = \"b\"", {"Host=b"});
+    check_parsed(input, "select Note where Note = \"\"", {"Note="});
+
+    check_parsed("", "select Op", {});
+    check_parsed("EOE\n", "select Op", {""});
+}
+
+TEST_CASE("RecsParser skips a delimiter line before a record", "[recs_parser]")
+{
+    const std::string input =
+        "---\nOp=Get\nEOE\n"
+        "-----------------------------------------\nOp=Put\nEOE\n"
+        "Op=Del\nEOE\n"
+        "-\nEOE\n";
+
+    check_parsed(input, "select Op", {"Op=Get", "Op=Put", "Op=Del", ""});
+    check_parsed(input, "select Op where Op != \"Get\"", {"Op=Put", "Op=Del"});
+
+    // The line after a record skipped by the filter is a first line too
+    check_parsed(input, "select Op where Op = \"Del\"", {"Op=Del"});
+
+    // Anywhere else it's not a name=value line
+    check_error("Op=Get\n---\nEOE\n", "select Op", "Can not parse recs stream: not a name=value line: ---");
+}
+
+TEST_CASE("RecsParser ends a record only at an EOE line", "[recs_parser]")
+{
+    // Values and names that look like the end of a record, in the records skipped by the filter too
+    const std::string input =
+        "Op=Get\nNote=EOE\nEOE=1\nSize=EOE\nNote=\nEOE\n"
+        "Op=Put\nNote=EOE\nEOEOE=\nEOE\n"
+        "Note=x\nEOE\nOp=Del\nNote=\nEOE\n"
+        "Op=Get\nNote=EOE EOE\nEOE\n";
+
+    check_parsed(input, "select Op, Note", {"Note= Op=Get", "Note=EOE Op=Put", "Note=x", "Note= Op=Del",
+                                            "Note=EOE EOE Op=Get"});
+    check_parsed(input, "select Op, Note where Op = \"Put\"", {"Note=EOE Op=Put"});
+    check_parsed(input, "select Op, Note where Note = \"EOE\"", {"Note=EOE Op=Put"});
+    check_parsed(input, "select Op, Note where Op = \"Del\"", {"Note= Op=Del"});
+    check_parsed(input, "select Op where Size = \"EOE\"", {"Op=Get Size=EOE"});
+
+    check_error("Op=Get\nNote=EOE\n", "select Op", "Can not parse recs stream: unexpected EOF");
+    check_error("Op=Get\nEOE", "select Op", "Can not parse recs stream: unexpected EOF");
+    check_error("Op=Get\nEOE\nOp=Put\nSize=1\nEO\n", "select Op", "Can not parse recs stream: not a name=value line: EO");
+}
+
+TEST_CASE("RecsParser takes the last value of a field set again", "[recs_parser]")
+{
+    // The filter fails on the first value and the record is parsed again
+    const std::string input =
+        "Op=Get\nSize=1\nOp=Put\nEOE\n"
+        "Op=Put\nSize=2\nOp=Get\nEOE\n"
+        "Size=10\nOp=Put\nSize=3\nEOE\n"
+        "Op=Del\nSize=4\nOp=Del\nEOE\n";
+
+    check_parsed(input, "select Op, Size", {"Op=Put Size=1", "Op=Get Size=2", "Op=Put Size=3", "Op=Del Size=4"});
+    check_parsed(input, "select Op, Size where Op = \"Put\"", {"Op=Put Size=1", "Op=Put Size=3"});
+    check_parsed(input, "select Op, Size where Op = \"Get\"", {"Op=Get Size=2"});
+    check_parsed(input, "select Op, Size where Size > 5", {});
+    check_parsed(input, "select Op, Size where Op = \"Put\" and Size < 3", {"Op=Put Size=1"});
+    check_parsed(input, "select Op, Size where Op = \"Del\" or Size = 10", {"Op=Del Size=4"});
+
+    // Set again in a Timing line
+    check_parsed("timer-load-count=1\nTiming=load:1/5\nEOE\n"
+                 "Timing=load:1/5\nOp=Get\nTiming=load:1/1\nEOE\n",
+                 "select Op, timer-load-count where timer-load-count > 2", {"timer-load-count=5"});
+}
+
+TEST_CASE("RecsParser parses the entries of Timing and Counters lines", "[recs_parser]")
+{
+    const std::string input =
+        "Op=Get\nTiming=load:12.5/3,save:1/1,other:0/0\nCounters=bytes=100,files=2\nEOE\n"
+        "Op=Put\nTiming=save:0.5/2\nCounters=files=7\nEOE\n"
+        "Op=Del\nTiming=\nCounters=\nEOE\n";
+
+    const std::string fields = "select Op, timer-load-time, timer-load-count, timer-save-time, counter-bytes-value, counter-files-value";
+
+    check_parsed(input, fields, {
+        "Op=Get counter-bytes-value=100 counter-files-value=2 timer-load-count=3 timer-load-time=12.5 timer-save-time=1",
+        "Op=Put counter-files-value=7 timer-save-time=0.5",
+        "Op=Del",
+    });
+    check_parsed(input, fields + " where timer-load-count >= 3", {
+        "Op=Get counter-bytes-value=100 counter-files-value=2 timer-load-count=3 timer-load-time=12.5 timer-save-time=1",
+    });
+    check_parsed(input, "select Op where counter-files-value > 2", {"Op=Put counter-files-value=7"});
+    check_parsed(input, "select Op where timer-save-time < 1", {"Op=Put timer-save-time=0.5"});
+
+    // Entries of no interest are not parsed
+    check_parsed("Timing=load\nCounters=bytes\nEOE\n", "select Op", {""});
+
+    check_error("Timing=load\nEOE\n", "select timer-load-time", "Can not parse recs stream: invalid 'Timing' field: load");
+    check_error("Timing=load:1\nEOE\n", "select timer-load-time", "Can not parse recs stream: invalid 'Timing' field: 1");
+    check_error("Counters=bytes\nEOE\n", "select counter-bytes-value",
+                "Can not parse recs stream: invalid 'Counters' field: bytes");
+}
+
+TEST_CASE("RecsParser matches records while parsing only with a filter", "[recs_parser]")
+{
+    const Query q("select Op, Size where Op = \"Get\" and Size > 1");
+    const std::string input =
+        "Op=Get\nSize=2\nEOE\n"
+        "Size=2\nOp=Put\nHost=a\nEOE\n"
+        "Size=2\nOp=Get\nHost=a\nEOE\n";
+
+    for (auto block_size: Block_Sizes)
+    {
+        INFO("block size " << block_size);
+
+        std::istringstream unfiltered_input(input);
+        RecsParser unfiltered(unfiltered_input, q.schema(), nullptr, block_size);
+        size_t records = 0;
+
+        for (; unfiltered.next(); ++records)
+            CHECK_FALSE(unfiltered.matched());
+        CHECK(records == 3);
+
+        // A rejected record is skipped when no field of the filter is set again in the rest of it
+        std::istringstream filtered_input(input);
+        RecsParser filtered(filtered_input, q.schema(), &q.where(), block_size);
+
+        REQUIRE(filtered.next());
+        CHECK(filtered.matched());
+        CHECK(to_string(filtered.current()) == "Op=Get Size=2");
+        REQUIRE(filtered.next());
+        CHECK(filtered.matched());
+        CHECK(to_string(filtered.current()) == "Op=Get Size=2");
+        CHECK_FALSE(filtered.next());
+
+        // A record parsed with no filter is returned whatever it is
+        RecsParser sampled(string_view(input), q.schema(), &q.where());
+
+        REQUIRE(sampled.next(false));
+        CHECK_FALSE(sampled.matched());
+        REQUIRE(sampled.next(false));
+        CHECK_FALSE(sampled.matched());
+        CHECK(to_string(sampled.current()) == "Op=Put Size=2");
+        REQUIRE(sampled.next());
+        CHECK(sampled.matched());
+        CHECK_FALSE(sampled.next(false));
+    }
+}
+
+TEST_CASE("RecsParser takes an invalid value of a declared field as NULL", "[recs_parser]")
+{
+    FieldTypes types;
+    types.add("Size", FieldKind::int64);
+    types.add("Time", FieldKind::time);
+
+    const RecordSchema schema(FieldSet{Name("Size"), Name("Time"), Name("Op")}, &types);
+    const std::string input =
+        "Op=Get\nSize=abc\nTime=12 msecs 500 usecs\nEOE\n"
+        "Op=Put\nSize=5\nTime=soon\nEOE\n"
+        "Op=Del\nSize=\nEOE\n";
+
+    RecsParser parser{string_view(input), schema};
+
+    REQUIRE(parser.next());
+    CHECK(parser.current().get(Name("Op")).as_string() == "Get");
+    CHECK(parser.current().has(Name("Size")));
+    CHECK(parser.current().get(Name("Size")).is_null());
+    CHECK(parser.current().get(Name("Time")).as_double() == 12.5);
+
+    REQUIRE(parser.next());
+    CHECK(parser.current().get(Name("Op")).as_string() == "Put");
+    CHECK(parser.current().get(Name("Size")).as_int64() == 5);
+    CHECK(parser.current().get(Name("Time")).is_null());
+
+    REQUIRE(parser.next());
+    CHECK(parser.current().get(Name("Op")).as_string() == "Del");
+    CHECK(parser.current().get(Name("Size")).is_null());
+
+    CHECK_FALSE(parser.next());
+    CHECK(parser.invalid_values() == 3);
+}
@@ -0,0 +1,154 @@
+#include "catch.hpp"
+#include "fql.h"
+#include "predicates.h"
+#include "rewrite.h"
+
+#include <sstream>
+#include <string>
+
+using namespace fastfood;
+
+
+namespace {
+    PredicatePtr parse_where(const std::string& where)
+    {
+        return fql::parse_query("select x where " + where).m_where;
+    }
+
+    std::string to_string(const Predicate& predicate)
+    {
+        std::ostringstream os;
+        predicate.print(os);
+        return os.str();
+    }
+
+    std::string rewritten(const std::string& where)
+    {
+        return to_string(*rewrite(*parse_where(where)));
+    }
+
+    // Values of x and y the rewritten predicates are checked on, nullptr is a missing field
+    const char *const Values[] = {
+        nullptr, "-inf", "-1", "-0", "0", "0.5", "1", "1.5", "2", "3", "nan", "a", "b", "",
+    };
+
+    // The rewritten predicate must match the same records as the original one
+    void check_equivalent(const std::string& where)
+    {
+        INFO(where);
+
+        auto original = parse_where(where);
+        auto result = rewrite(*original);
+
+        const RecordSchema schema(FieldSet{Name("x"), Name("y")});
+        original->bind(schema);
+        result->bind(schema);
+
+        for (auto x: Values)
+            for (auto y: Values)
+            {
+                MutableRecord record(schema);
+                if (x)
+                    record.set(Name("x"), string_view(x));
+                if (y)
+                    record.set(Name("y"), string_view(y));
+
+                INFO("x = " << (x ? x : "<none>") << ", y = " << (y ? y : "<none>"));
+                CHECK(result->match(record) == original->match(record));
+            }
+    }
+}
+
+
+TEST_CASE("rewrite merges bounds of a field into a range", "[rewrite]")
+{
+    CHECK(rewritten("x > 1 and x <= 5") == "1 < x <= 5");
+    CHECK(rewritten("x >= 1 and x > 0 and x < 5 and x < 7") == "1 <= x < 5");
+    CHECK(rewritten("x > 1 and (y = \"a\" and x < 5)") == "(1 < x < 5 && y == \"a\")");
+    CHECK(rewritten("x >= 1 and x <= 1") == "x == 1");
+    CHECK(rewritten("x >= 1 and x != 2") == "(x >= 1 && x != 2)");
+
+    check_equivalent("x > 1 and x <= 5");
+    check_equivalent("x >= 1 and x > 0 and x < 5 and x < 7");
+    check_equivalent("x >= 1 and x <= 1");
+    check_equivalent("x >= 1 and x != 2 and x < 3");
+}
+
+TEST_CASE("rewrite folds contradictions", "[rewrite]")
+{
+    for (auto where: {"x < 1 and x > 2", "x > 1 and x < 1", "x >= 1 and x < 1", "x = 1 and x = 2",
+                      "x = 1 and x != 1", "x = 3 and x < 2", "x = \"a\" and x = \"b\"", "x = \"a\" and x != \"a\"",
+                      "y = 1 and (x > 2 and x < 1)"})
+    {
+        INFO(where);
+        CHECK(never_matches(*rewrite(*parse_where(where))));
+        check_equivalent(where);
+    }
+
+    // A contradiction in an OR only drops the branch
+    CHECK(rewritten("x < 1 and x > 2 or y = 1") == "y == 1");
+    CHECK(rewritten("(x < 1 and x > 2) and y = 1 or x = 2") == "x == 2");
+
+    // Strings and numbers of the same field are not comparable with each other
+    CHECK_FALSE(never_matches(*rewrite(*parse_where("x = 1 and x = \"a\""))));
+    check_equivalent("x = 1 and x = \"a\"");
+    check_equivalent("x < 1 and x > 2 or y = 1");
+}
+
+TEST_CASE("rewrite keeps comparisons with NaN as they are", "[rewrite]")
+{
+    CHECK(rewritten("x = nan and x = 1") == "(x == nan && x == 1)");
+    CHECK(rewritten("x != nan and x > 1 and x < 2") == "(x != nan && 1 < x < 2)");
+    CHECK(rewritten("x = nan or x = 1") == "(x == nan || x == 1)");
+    CHECK_FALSE(never_matches(*rewrite(*parse_where("x < nan and x > nan"))));
+
+    for (auto where: {"x = nan and x = 1", "x != nan and x > 1 and x < 2", "x = nan or x = 1", "x < nan and x > nan",
+                      "x != nan or x = 1"})
+        check_equivalent(where);
+}
+
+TEST_CASE("rewrite treats -0 as 0", "[rewrite]")
+{
+    CHECK(rewritten("x = -0 or x = 0") == "x == 0");
+    CHECK(rewritten("x >= -0 and x <= 0") == "x == 0");
+    CHECK(never_matches(*rewrite(*parse_where("x > -0 and x < 0"))));
+    CHECK(never_matches(*rewrite(*parse_where("x = -0 and x != 0"))));
+
+    for (auto where: {"x = -0 or x = 0", "x >= -0 and x <= 0", "x > -0 and x < 0", "x = -0 and x != 0", "x = -0"})
+        check_equivalent(where);
+}
+
+TEST_CASE("rewrite merges equalities of a field into a set", "[rewrite]")
+{
+    CHECK(rewritten("x = 1 or x = 2 or x = 1") == "x in (1, 2)");
+    CHECK(rewritten("x = \"a\" or y = 1 or x = \"b\"") == "(x in (\"a\", \"b\") || y == 1)");
+    CHECK(rewritten("x = 1 or x = \"a\" or x = 2") == "(x in (1, 2) || x == \"a\")");
+    CHECK(rewritten("x = 1 or (x = 2 or x = 3)") == "x in (1, 2, 3)");
+
+    // Nested ORs are flattened before their equalities are merged
+    CHECK(rewritten("(x = 1 or x = 2) or x = 3 or (x = 2 or x = 4)") == "x in (1, 2, 3, 4)");
+
+    for (auto where: {"x = 1 or x = 2 or x = 1", "x = \"a\" or y = 1 or x = \"b\"", "x = 1 or x = \"a\" or x = 2",
+                      "x = 1 or x > 2 or x = 0.5", "(x = 1 or x = 2) and y = 3"})
+        check_equivalent(where);
+}
+
+TEST_CASE("rewrite merges ranges and sets rewritten before", "[rewrite]")
+{
+    // A tree that already has ranges and sets, e.g. a rewritten one
+    std::vector<PredicatePtr> children{
+        std::make_shared<NumberRangePredicate>("x", 0, true, 10, false),
+        std::make_shared<BinaryFieldPredicate<Greater, double>>("x", 5),
+    };
+    const PredicateConjunction conjunction(children.begin(), children.end());
+    CHECK(to_string(*rewrite(conjunction)) == "5 < x < 10");
+
+    std::vector<PredicatePtr> alternatives{
+        std::make_shared<FieldSetPredicate<std::string>>("x", std::vector<std::string>{"b", "a"}),
+        std::make_shared<BinaryFieldPredicate<EqualTo, std::string>>("x", "c"),
+    };
+    const PredicateDisjunction disjunction(alternatives.begin(), alternatives.end());
+    CHECK(to_string(*rewrite(disjunction)) == "x in (\"a\", \"b\", \"c\")");
+
+    CHECK(to_string(*rewrite(*rewrite(*parse_where("x = 1 or x = 2 or y > 1 and y < 3")))) == "(x in (1, 2) || 1 < y < 3)");
+}